@@ -0,0 +1,372 @@
+/* See LICENSE file for license and copyright information */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <glib.h>
+#include <cairo.h>
+
+#include "plugin.h"
+#include "zathura-stubs.h"
+
+/** An opened document and its initialized pages
+ */
+typedef struct bench_document_s {
+  zathura_document_t* document; /**< The document */
+  zathura_page_t** pages; /**< Pages of the document */
+  unsigned int number_of_pages; /**< Number of pages */
+} bench_document_t;
+
+/** Summary of a series of timings
+ */
+typedef struct bench_stats_s {
+  unsigned int count; /**< Number of samples */
+  double total; /**< Sum of all samples in ms */
+  double mean; /**< Mean in ms */
+  double median; /**< Median in ms */
+  double max; /**< Maximum in ms */
+  long rss_delta; /**< Change of the resident set size over the stage in KiB */
+  long peak_rss; /**< Process-wide peak resident set size so far in KiB */
+} bench_stats_t;
+
+typedef enum bench_order_e {
+  BENCH_ORDER_SEQUENTIAL,
+  BENCH_ORDER_REVERSE,
+  BENCH_ORDER_RANDOM
+} bench_order_t;
+
+static const char* order_names[] = { "sequential", "reverse", "random" };
+
+static gboolean json = FALSE;
+static double scale = 1.0;
+static gint seed = 1;
+
+static GOptionEntry entries[] = {
+  { "json", 'j', 0, G_OPTION_ARG_NONE, &json, "Print the results as JSON", NULL },
+  { "scale", 's', 0, G_OPTION_ARG_DOUBLE, &scale, "Zoom level pages are rendered at (default: 1.0)", "SCALE" },
+  { "seed", 0, 0, G_OPTION_ARG_INT, &seed, "Seed of the random page order (default: 1)", "SEED" },
+  { NULL, 0, 0, 0, NULL, NULL, NULL }
+};
+
+static long
+get_current_rss(void)
+{
+  FILE* file = fopen("/proc/self/statm", "r");
+  if (file == NULL) {
+    return -1;
+  }
+
+  long pages = -1;
+  if (fscanf(file, "%*ld %ld", &pages) != 1) {
+    pages = -1;
+  }
+  fclose(file);
+
+  const long page_size = sysconf(_SC_PAGESIZE);
+  if (pages < 0 || page_size <= 0) {
+    return -1;
+  }
+
+  return pages * (page_size / 1024);
+}
+
+static long
+get_peak_rss(void)
+{
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return -1;
+  }
+
+  /* KiB on Linux */
+  return usage.ru_maxrss;
+}
+
+static int
+compare_samples(const void* data1, const void* data2)
+{
+  const gint64 a = *(const gint64*) data1;
+  const gint64 b = *(const gint64*) data2;
+
+  return (a > b) - (a < b);
+}
+
+static bench_stats_t
+get_stats(GArray* samples, long rss_start, long rss_end)
+{
+  bench_stats_t stats = { 0 };
+  stats.count = samples->len;
+  stats.rss_delta = rss_start >= 0 && rss_end >= 0 ? rss_end - rss_start : 0;
+  stats.peak_rss = get_peak_rss();
+  if (samples->len == 0) {
+    return stats;
+  }
+
+  g_array_sort(samples, compare_samples);
+  for (unsigned int i = 0; i < samples->len; i++) {
+    stats.total += g_array_index(samples, gint64, i) / 1000.0;
+  }
+  stats.mean = stats.total / samples->len;
+  stats.median = g_array_index(samples, gint64, samples->len / 2) / 1000.0;
+  stats.max = g_array_index(samples, gint64, samples->len - 1) / 1000.0;
+
+  return stats;
+}
+
+static void
+close_document(bench_document_t* bench)
+{
+  for (unsigned int i = 0; i < bench->number_of_pages; i++) {
+    if (bench->pages[i] != NULL) {
+      cb_page_clear(bench->pages[i], bench_page_get_data(bench->pages[i]));
+      bench_page_free(bench->pages[i]);
+    }
+  }
+  g_free(bench->pages);
+
+  cb_document_free(bench->document, zathura_document_get_data(bench->document));
+  bench_document_free(bench->document);
+}
+
+static bool
+open_document(bench_document_t* bench, const char* path, gint64* open_time, GArray* init_samples,
+    long rss[3])
+{
+  bench->document = bench_document_new(path);
+  bench->pages = NULL;
+  bench->number_of_pages = 0;
+
+  rss[0] = get_current_rss();
+  const gint64 start = g_get_monotonic_time();
+  if (cb_document_open(bench->document) != ZATHURA_ERROR_OK) {
+    bench_document_free(bench->document);
+    return false;
+  }
+  *open_time = g_get_monotonic_time() - start;
+  rss[1] = get_current_rss();
+
+  bench->number_of_pages = zathura_document_get_number_of_pages(bench->document);
+  bench->pages = g_new0(zathura_page_t*, bench->number_of_pages);
+  for (unsigned int i = 0; i < bench->number_of_pages; i++) {
+    zathura_page_t* page = bench_page_new(bench->document, i);
+
+    const gint64 page_start = g_get_monotonic_time();
+    const zathura_error_t error = cb_page_init(page);
+    const gint64 page_time = g_get_monotonic_time() - page_start;
+    if (error != ZATHURA_ERROR_OK) {
+      bench_page_free(page);
+      close_document(bench);
+      return false;
+    }
+
+    g_array_append_val(init_samples, page_time);
+    bench->pages[i] = page;
+  }
+  rss[2] = get_current_rss();
+
+  return true;
+}
+
+static bool
+render_page(zathura_page_t* page, gint64* time)
+{
+  const int width = MAX(ceil(zathura_page_get_width(page) * scale), 1);
+  const int height = MAX(ceil(zathura_page_get_height(page) * scale), 1);
+
+  /* like zathura, render into a new image surface of the displayed size */
+  const gint64 start = g_get_monotonic_time();
+  cairo_surface_t* surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, width, height);
+  cairo_t* cairo = cairo_create(surface);
+  cairo_scale(cairo, scale, scale);
+
+  const zathura_error_t error = cb_page_render_cairo(page, bench_page_get_data(page), cairo, false);
+
+  cairo_destroy(cairo);
+  cairo_surface_destroy(surface);
+  *time = g_get_monotonic_time() - start;
+
+  return error == ZATHURA_ERROR_OK;
+}
+
+static bool
+render_pages(bench_document_t* bench, const unsigned int* order, GArray* samples)
+{
+  for (unsigned int i = 0; i < bench->number_of_pages; i++) {
+    gint64 time = 0;
+    if (render_page(bench->pages[order[i]], &time) == false) {
+      fprintf(stderr, "error: failed to render page %u\n", order[i] + 1);
+      return false;
+    }
+    g_array_append_val(samples, time);
+  }
+
+  return true;
+}
+
+static unsigned int*
+create_order(bench_order_t type, unsigned int number_of_pages)
+{
+  unsigned int* order = g_new(unsigned int, MAX(number_of_pages, 1));
+  for (unsigned int i = 0; i < number_of_pages; i++) {
+    order[i] = type == BENCH_ORDER_REVERSE ? number_of_pages - 1 - i : i;
+  }
+
+  if (type == BENCH_ORDER_RANDOM && number_of_pages > 1) {
+    GRand* rand = g_rand_new_with_seed(seed);
+    for (unsigned int i = number_of_pages - 1; i > 0; i--) {
+      const unsigned int j = g_rand_int_range(rand, 0, i + 1);
+      const unsigned int tmp = order[i];
+      order[i] = order[j];
+      order[j] = tmp;
+    }
+    g_rand_free(rand);
+  }
+
+  return order;
+}
+
+static void
+append_json_string(GString* out, const char* string)
+{
+  g_string_append_c(out, '"');
+  for (const char* c = string; *c != '\0'; c++) {
+    if (*c == '"' || *c == '\\') {
+      g_string_append_printf(out, "\\%c", *c);
+    } else if ((unsigned char) *c < 0x20) {
+      g_string_append_printf(out, "\\u%04x", (unsigned char) *c);
+    } else {
+      g_string_append_c(out, *c);
+    }
+  }
+  g_string_append_c(out, '"');
+}
+
+static void
+append_json_stats(GString* out, const bench_stats_t* stats)
+{
+  g_string_append_printf(out, "{\"count\": %u, \"total_ms\": %.3f, \"mean_ms\": %.3f, "
+      "\"median_ms\": %.3f, \"max_ms\": %.3f, \"rss_delta_kib\": %ld, "
+      "\"process_peak_rss_kib\": %ld}", stats->count, stats->total, stats->mean, stats->median,
+      stats->max, stats->rss_delta, stats->peak_rss);
+}
+
+static void
+print_stats(const char* name, const bench_stats_t* stats)
+{
+  printf("%-18s %5u pages %10.3f ms total %8.3f ms mean %8.3f ms median %8.3f ms max"
+      "  RSS %+ld KiB  process peak RSS %ld KiB\n", name, stats->count, stats->total,
+      stats->mean, stats->median, stats->max, stats->rss_delta, stats->peak_rss);
+}
+
+int
+main(int argc, char* argv[])
+{
+  GOptionContext* context = g_option_context_new("ARCHIVE");
+  g_option_context_set_summary(context, "Measures opening and rendering a comic book archive.\n\n"
+      "The plugin is configured with the usual ZATHURA_CB_* environment variables; the\n"
+      "on-disk caches are disabled unless ZATHURA_CB_METADATA_CACHE or\n"
+      "ZATHURA_CB_THUMBNAIL_CACHE are set explicitly.");
+  g_option_context_add_main_entries(context, entries, NULL);
+
+  GError* error = NULL;
+  if (g_option_context_parse(context, &argc, &argv, &error) == FALSE || argc != 2 || scale <= 0) {
+    fprintf(stderr, "%s\n", error != NULL ? error->message : "usage: cb-bench [OPTION...] ARCHIVE");
+    g_clear_error(&error);
+    g_option_context_free(context);
+    return EXIT_FAILURE;
+  }
+  g_option_context_free(context);
+
+  const char* path = argv[1];
+
+  /* results from previous runs would make opening look free */
+  g_setenv("ZATHURA_CB_METADATA_CACHE", "0", FALSE);
+  g_setenv("ZATHURA_CB_THUMBNAIL_CACHE", "0", FALSE);
+
+  /* opening and page initialization */
+  bench_document_t bench;
+  gint64 open_time = 0;
+  GArray* init_samples = g_array_new(FALSE, FALSE, sizeof(gint64));
+  long rss[3] = { -1, -1, -1 };
+  if (open_document(&bench, path, &open_time, init_samples, rss) == false) {
+    fprintf(stderr, "error: failed to open %s\n", path);
+    g_array_free(init_samples, TRUE);
+    return EXIT_FAILURE;
+  }
+
+  const unsigned int number_of_pages = bench.number_of_pages;
+  GArray* open_samples = g_array_new(FALSE, FALSE, sizeof(gint64));
+  g_array_append_val(open_samples, open_time);
+  const bench_stats_t open_stats = get_stats(open_samples, rss[0], rss[1]);
+  const bench_stats_t init_stats = get_stats(init_samples, rss[1], rss[2]);
+  g_array_free(open_samples, TRUE);
+  g_array_free(init_samples, TRUE);
+
+  /* every order starts with a freshly opened document, so that the first
+   * pass sees empty caches */
+  bench_stats_t render_stats[G_N_ELEMENTS(order_names)][2];
+  bool ok = true;
+  for (unsigned int type = 0; type < G_N_ELEMENTS(order_names) && ok == true; type++) {
+    if (type > 0) {
+      GArray* ignored = g_array_new(FALSE, FALSE, sizeof(gint64));
+      ok = open_document(&bench, path, &open_time, ignored, rss);
+      g_array_free(ignored, TRUE);
+      if (ok == false) {
+        fprintf(stderr, "error: failed to open %s\n", path);
+        break;
+      }
+    }
+
+    unsigned int* order = create_order(type, number_of_pages);
+    for (unsigned int pass = 0; pass < 2 && ok == true; pass++) {
+      GArray* samples = g_array_new(FALSE, FALSE, sizeof(gint64));
+      const long rss_start = get_current_rss();
+      ok = render_pages(&bench, order, samples);
+      render_stats[type][pass] = get_stats(samples, rss_start, get_current_rss());
+      g_array_free(samples, TRUE);
+    }
+    g_free(order);
+
+    close_document(&bench);
+  }
+
+  if (ok == false) {
+    return EXIT_FAILURE;
+  }
+
+  if (json == TRUE) {
+    GString* out = g_string_new("{\"archive\": ");
+    append_json_string(out, path);
+    g_string_append_printf(out, ", \"pages\": %u, \"scale\": %g, \"open\": ", number_of_pages, scale);
+    append_json_stats(out, &open_stats);
+    g_string_append(out, ", \"page_init\": ");
+    append_json_stats(out, &init_stats);
+    g_string_append(out, ", \"render\": {");
+    for (unsigned int type = 0; type < G_N_ELEMENTS(order_names); type++) {
+      g_string_append_printf(out, "%s\"%s\": {\"cold\": ", type > 0 ? ", " : "", order_names[type]);
+      append_json_stats(out, &render_stats[type][0]);
+      g_string_append(out, ", \"warm\": ");
+      append_json_stats(out, &render_stats[type][1]);
+      g_string_append(out, "}");
+    }
+    g_string_append(out, "}}\n");
+    fputs(out->str, stdout);
+    g_string_free(out, TRUE);
+  } else {
+    printf("%s: %u pages at scale %g\n", path, number_of_pages, scale);
+    print_stats("open", &open_stats);
+    print_stats("page init", &init_stats);
+    for (unsigned int type = 0; type < G_N_ELEMENTS(order_names); type++) {
+      char* name = g_strdup_printf("render %s cold", order_names[type]);
+      print_stats(name, &render_stats[type][0]);
+      g_free(name);
+      name = g_strdup_printf("render %s warm", order_names[type]);
+      print_stats(name, &render_stats[type][1]);
+      g_free(name);
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
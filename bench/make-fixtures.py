@@ -0,0 +1,138 @@
+#!/usr/bin/env python3
+# See LICENSE file for license and copyright information
+
+"""Generates synthetic comic book archives for cb-bench.
+
+The pages are gradients with a band of noise, so that they compress roughly
+like scanned pages. PNG pages are written without any dependencies; JPEG
+pages need Pillow. CB7 archives are created with the 7z command or py7zr.
+"""
+
+import argparse
+import io
+import os
+import shutil
+import struct
+import subprocess
+import sys
+import tarfile
+import tempfile
+import zipfile
+import zlib
+
+
+def png_chunk(kind, data):
+    chunk = kind + data
+    return struct.pack(">I", len(data)) + chunk + struct.pack(">I", zlib.crc32(chunk))
+
+
+def page_rows(index, width, height):
+    # a horizontal gradient shifted on every row, with a band of noise
+    base = bytes((x * 255 // max(width - 1, 1)) for x in range(width)) * 3
+    noise = os.urandom(width * 3)
+    for y in range(height):
+        offset = (y + index * 7) % len(base)
+        row = base[offset:] + base[:offset]
+        if height // 3 <= y < height // 2:
+            row = bytes(a ^ (b & 0x1f) for a, b in zip(row[:width * 3], noise))
+        yield row[:width * 3]
+
+
+def make_png(index, width, height):
+    raw = b"".join(b"\x00" + row for row in page_rows(index, width, height))
+    header = struct.pack(">IIBBBBB", width, height, 8, 2, 0, 0, 0)
+    return (b"\x89PNG\r\n\x1a\n" + png_chunk(b"IHDR", header)
+            + png_chunk(b"IDAT", zlib.compress(raw, 6)) + png_chunk(b"IEND", b""))
+
+
+def make_jpeg(index, width, height):
+    try:
+        from PIL import Image
+    except ImportError:
+        sys.exit("error: JPEG pages need Pillow")
+
+    raw = b"".join(page_rows(index, width, height))
+    out = io.BytesIO()
+    Image.frombytes("RGB", (width, height), raw).save(out, "JPEG", quality=85)
+    return out.getvalue()
+
+
+def write_pages(directory, args):
+    make = make_png if args.image_format == "png" else make_jpeg
+    names = []
+    for index in range(args.pages):
+        name = "page-{}.{}".format(index + 1, "png" if args.image_format == "png" else "jpg")
+        with open(os.path.join(directory, name), "wb") as f:
+            f.write(make(index, args.width, args.height))
+        names.append(name)
+    return names
+
+
+def write_cbz(path, directory, names):
+    with zipfile.ZipFile(path, "w", zipfile.ZIP_DEFLATED) as archive:
+        for name in names:
+            archive.write(os.path.join(directory, name), name)
+
+
+def write_cbt(path, directory, names):
+    with tarfile.open(path, "w") as archive:
+        for name in names:
+            archive.add(os.path.join(directory, name), name)
+
+
+def write_cb7(path, directory, names):
+    path = os.path.abspath(path)
+    if os.path.exists(path):
+        os.remove(path)
+
+    for tool in ("7z", "7za", "7zr"):
+        if shutil.which(tool) is not None:
+            subprocess.run([tool, "a", "-bd", "-y", path] + names, cwd=directory,
+                           check=True, stdout=subprocess.DEVNULL)
+            return True
+
+    try:
+        import py7zr
+    except ImportError:
+        print("warning: skipping CB7, neither 7z nor py7zr is available", file=sys.stderr)
+        return False
+
+    with py7zr.SevenZipFile(path, "w") as archive:
+        for name in names:
+            archive.write(os.path.join(directory, name), name)
+    return True
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--pages", type=int, default=50, help="number of pages (default: 50)")
+    parser.add_argument("--width", type=int, default=1600, help="page width (default: 1600)")
+    parser.add_argument("--height", type=int, default=2400, help="page height (default: 2400)")
+    parser.add_argument("--image-format", choices=("png", "jpeg"), default="png",
+                        help="format of the pages (default: png)")
+    parser.add_argument("--formats", default="cbz,cbt,cb7",
+                        help="comma separated archive formats (default: cbz,cbt,cb7)")
+    parser.add_argument("--output", default=".", help="output directory (default: .)")
+    args = parser.parse_args()
+
+    if args.pages < 1 or args.width < 1 or args.height < 1:
+        parser.error("the number of pages and the page size must be positive")
+
+    writers = {"cbz": write_cbz, "cbt": write_cbt, "cb7": write_cb7}
+    formats = [f.strip() for f in args.formats.split(",") if f.strip() != ""]
+    for f in formats:
+        if f not in writers:
+            parser.error("unknown archive format: " + f)
+
+    os.makedirs(args.output, exist_ok=True)
+    with tempfile.TemporaryDirectory() as directory:
+        names = write_pages(directory, args)
+        for f in formats:
+            path = os.path.join(args.output, "bench-{}-{}x{}-{}.{}".format(
+                args.pages, args.width, args.height, args.image_format, f))
+            if writers[f](path, directory, names) is not False:
+                print(path)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,152 @@
+/* See LICENSE file for license and copyright information */
+
+#include <glib.h>
+#include <girara/macros.h>
+
+#include "zathura-stubs.h"
+
+/* Only the state the plugin reads and writes is kept; everything else zathura
+ * does with documents and pages is irrelevant for the benchmark. */
+
+struct zathura_document_s {
+  char* path;
+  void* data;
+  unsigned int number_of_pages;
+};
+
+struct zathura_page_s {
+  zathura_document_t* document;
+  unsigned int index;
+  double width;
+  double height;
+  void* data;
+};
+
+zathura_document_t*
+bench_document_new(const char* path)
+{
+  zathura_document_t* document = g_malloc0(sizeof(zathura_document_t));
+  document->path = g_strdup(path);
+
+  return document;
+}
+
+void
+bench_document_free(zathura_document_t* document)
+{
+  if (document == NULL) {
+    return;
+  }
+
+  g_free(document->path);
+  g_free(document);
+}
+
+zathura_page_t*
+bench_page_new(zathura_document_t* document, unsigned int index)
+{
+  zathura_page_t* page = g_malloc0(sizeof(zathura_page_t));
+  page->document = document;
+  page->index = index;
+
+  return page;
+}
+
+void
+bench_page_free(zathura_page_t* page)
+{
+  g_free(page);
+}
+
+void*
+bench_page_get_data(zathura_page_t* page)
+{
+  return page->data;
+}
+
+const char*
+zathura_document_get_path(zathura_document_t* document)
+{
+  return document->path;
+}
+
+void*
+zathura_document_get_data(zathura_document_t* document)
+{
+  return document->data;
+}
+
+void
+zathura_document_set_data(zathura_document_t* document, void* data)
+{
+  document->data = data;
+}
+
+unsigned int
+zathura_document_get_number_of_pages(zathura_document_t* document)
+{
+  return document->number_of_pages;
+}
+
+void
+zathura_document_set_number_of_pages(zathura_document_t* document, unsigned int number_of_pages)
+{
+  document->number_of_pages = number_of_pages;
+}
+
+zathura_document_t*
+zathura_page_get_document(zathura_page_t* page)
+{
+  return page->document;
+}
+
+unsigned int
+zathura_page_get_index(zathura_page_t* page)
+{
+  return page->index;
+}
+
+double
+zathura_page_get_width(zathura_page_t* page)
+{
+  return page->width;
+}
+
+void
+zathura_page_set_width(zathura_page_t* page, double width)
+{
+  page->width = width;
+}
+
+double
+zathura_page_get_height(zathura_page_t* page)
+{
+  return page->height;
+}
+
+void
+zathura_page_set_height(zathura_page_t* page, double height)
+{
+  page->height = height;
+}
+
+void
+zathura_page_set_data(zathura_page_t* page, void* data)
+{
+  page->data = data;
+}
+
+/* the index is not benchmarked */
+
+zathura_index_element_t*
+zathura_index_element_new(const char* UNUSED(title))
+{
+  return NULL;
+}
+
+zathura_link_t*
+zathura_link_new(zathura_link_type_t UNUSED(type), zathura_rectangle_t UNUSED(position),
+    zathura_link_target_t UNUSED(target))
+{
+  return NULL;
+}
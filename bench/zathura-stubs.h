@@ -0,0 +1,47 @@
+/* See LICENSE file for license and copyright information */
+
+#ifndef ZATHURA_STUBS_H
+#define ZATHURA_STUBS_H
+
+#include <zathura/plugin-api.h>
+
+/**
+ * Creates a document as zathura would pass it to cb_document_open
+ *
+ * @param path Path of the archive
+ * @return The document
+ */
+zathura_document_t* bench_document_new(const char* path);
+
+/**
+ * Frees a document. The plugin data must have been freed before.
+ *
+ * @param document The document
+ */
+void bench_document_free(zathura_document_t* document);
+
+/**
+ * Creates a page as zathura would pass it to cb_page_init
+ *
+ * @param document The document
+ * @param index Page index
+ * @return The page
+ */
+zathura_page_t* bench_page_new(zathura_document_t* document, unsigned int index);
+
+/**
+ * Frees a page. The plugin data must have been freed before.
+ *
+ * @param page The page
+ */
+void bench_page_free(zathura_page_t* page);
+
+/**
+ * Returns the plugin data of a page
+ *
+ * @param page The page
+ * @return The data set by cb_page_init
+ */
+void* bench_page_get_data(zathura_page_t* page);
+
+#endif // ZATHURA_STUBS_H
@@ -0,0 +1,131 @@
+/* See LICENSE file for license and copyright information */
+
+#include <glib.h>
+#include <limits.h>
+#include <avif/avif.h>
+
+#include "avif.h"
+
+static cairo_surface_t*
+transform_surface(cairo_surface_t* surface, const avifImage* image)
+{
+  /* the rotation is applied before the mirroring; angle counts quarter turns
+   * anti-clockwise, axis 0 swaps top and bottom, axis 1 left and right */
+  const unsigned int angle = (image->transformFlags & AVIF_TRANSFORM_IROT) != 0
+    ? image->irot.angle & 3 : 0;
+  const int axis = (image->transformFlags & AVIF_TRANSFORM_IMIR) != 0 ? image->imir.axis : -1;
+
+  const int width = cairo_image_surface_get_width(surface);
+  const int height = cairo_image_surface_get_height(surface);
+  const int out_width = angle % 2 == 1 ? height : width;
+  const int out_height = angle % 2 == 1 ? width : height;
+  cairo_surface_t* transformed = cairo_image_surface_create(
+      cairo_image_surface_get_format(surface), out_width, out_height);
+  if (cairo_surface_status(transformed) != CAIRO_STATUS_SUCCESS) {
+    cairo_surface_destroy(transformed);
+    return NULL;
+  }
+
+  const unsigned char* src = cairo_image_surface_get_data(surface);
+  const size_t src_stride = cairo_image_surface_get_stride(surface);
+  unsigned char* dst = cairo_image_surface_get_data(transformed);
+  const size_t dst_stride = cairo_image_surface_get_stride(transformed);
+
+  cairo_surface_flush(transformed);
+  for (int y = 0; y < out_height; y++) {
+    uint32_t* row = (uint32_t*) (dst + (size_t) y * dst_stride);
+    for (int x = 0; x < out_width; x++) {
+      /* undo the mirroring, then the rotation */
+      const int rx = axis == 1 ? out_width - 1 - x : x;
+      const int ry = axis == 0 ? out_height - 1 - y : y;
+      int sx = rx;
+      int sy = ry;
+      if (angle == 1) {
+        sx = width - 1 - ry;
+        sy = rx;
+      } else if (angle == 2) {
+        sx = width - 1 - rx;
+        sy = height - 1 - ry;
+      } else if (angle == 3) {
+        sx = ry;
+        sy = height - 1 - rx;
+      }
+      row[x] = ((const uint32_t*) (src + (size_t) sy * src_stride))[sx];
+    }
+  }
+  cairo_surface_mark_dirty(transformed);
+
+  return transformed;
+}
+
+cairo_surface_t*
+cb_avif_decode(const void* data, size_t size, unsigned int threads)
+{
+  if (data == NULL) {
+    return NULL;
+  }
+
+  avifDecoder* decoder = avifDecoderCreate();
+  if (decoder == NULL) {
+    return NULL;
+  }
+
+  /* dav1d decodes the tiles and rows of a frame on several threads */
+  decoder->maxThreads = MAX(threads, 1);
+  if (avifCodecName(AVIF_CODEC_CHOICE_DAV1D, AVIF_CODEC_FLAG_CAN_DECODE) != NULL) {
+    decoder->codecChoice = AVIF_CODEC_CHOICE_DAV1D;
+  }
+  decoder->ignoreExif = AVIF_TRUE;
+  decoder->ignoreXMP = AVIF_TRUE;
+
+  cairo_surface_t* surface = NULL;
+  if (avifDecoderSetIOMemory(decoder, data, size) != AVIF_RESULT_OK
+      || avifDecoderParse(decoder) != AVIF_RESULT_OK
+      || avifDecoderNextImage(decoder) != AVIF_RESULT_OK) {
+    goto error_free;
+  }
+
+  avifImage* image = decoder->image;
+  if (image->width > INT_MAX || image->height > INT_MAX) {
+    goto error_free;
+  }
+
+  surface = cairo_image_surface_create(
+      image->alphaPlane != NULL ? CAIRO_FORMAT_ARGB32 : CAIRO_FORMAT_RGB24,
+      image->width, image->height);
+  if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS) {
+    goto error_free;
+  }
+
+  /* cairo stores pixels as native-endian 32-bit words, 0xAARRGGBB; opaque
+   * images get an alpha of 255, which suits CAIRO_FORMAT_RGB24 as well */
+  avifRGBImage rgb;
+  avifRGBImageSetDefaults(&rgb, image);
+  rgb.format = G_BYTE_ORDER == G_LITTLE_ENDIAN ? AVIF_RGB_FORMAT_BGRA : AVIF_RGB_FORMAT_ARGB;
+  rgb.depth = 8;
+  rgb.alphaPremultiplied = AVIF_TRUE;
+  rgb.pixels = cairo_image_surface_get_data(surface);
+  rgb.rowBytes = cairo_image_surface_get_stride(surface);
+
+  cairo_surface_flush(surface);
+  if (avifImageYUVToRGB(image, &rgb) != AVIF_RESULT_OK) {
+    goto error_free;
+  }
+  cairo_surface_mark_dirty(surface);
+
+  if ((image->transformFlags & (AVIF_TRANSFORM_IROT | AVIF_TRANSFORM_IMIR)) != 0) {
+    cairo_surface_t* transformed = transform_surface(surface, image);
+    cairo_surface_destroy(surface);
+    surface = transformed;
+  }
+  avifDecoderDestroy(decoder);
+
+  return surface;
+
+error_free:
+
+  cairo_surface_destroy(surface);
+  avifDecoderDestroy(decoder);
+
+  return NULL;
+}
@@ -0,0 +1,25 @@
+/* See LICENSE file for license and copyright information */
+
+#ifndef AVIF_H
+#define AVIF_H
+
+#include <stddef.h>
+#include <cairo.h>
+
+#include <girara/macros.h>
+
+/**
+ * Decodes an AVIF image with libavif, using dav1d if libavif is built with it.
+ * The AV1 decoder works on several threads, and libavif writes the converted
+ * and premultiplied pixels directly into the surface. Images that are rotated
+ * or mirrored by their container (irot, imir) are transformed afterwards.
+ *
+ * @param data The AVIF data
+ * @param size Size of the data
+ * @param threads Maximum number of threads of the AV1 decoder
+ * @return A CAIRO_FORMAT_ARGB32 surface for images with alpha, a
+ *   CAIRO_FORMAT_RGB24 surface otherwise, or NULL if an error occurred
+ */
+GIRARA_HIDDEN cairo_surface_t* cb_avif_decode(const void* data, size_t size, unsigned int threads);
+
+#endif // AVIF_H
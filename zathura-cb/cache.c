@@ -0,0 +1,168 @@
+/* See LICENSE file for license and copyright information */
+
+#include <glib.h>
+
+#include "cache.h"
+
+typedef struct cb_cache_entry_s {
+  unsigned int index; /**< Page index */
+  unsigned int level; /**< Scale level of the surface */
+  cairo_surface_t* surface; /**< Decoded page */
+  size_t size; /**< Size of the image data in bytes */
+} cb_cache_entry_t;
+
+struct cb_cache_s {
+  GMutex lock; /**< Protects all members below */
+  GHashTable* entries; /**< Page index to link in lru */
+  GQueue lru; /**< Entries, most recently used first */
+  cb_cache_stats_t stats; /**< Statistics */
+};
+
+static size_t
+surface_size(cairo_surface_t* surface)
+{
+  return (size_t) cairo_image_surface_get_stride(surface)
+    * (size_t) cairo_image_surface_get_height(surface);
+}
+
+static void
+cache_entry_free(cb_cache_entry_t* entry)
+{
+  cairo_surface_destroy(entry->surface);
+  g_free(entry);
+}
+
+static void
+cache_remove_link(cb_cache_t* cache, GList* link)
+{
+  cb_cache_entry_t* entry = link->data;
+
+  g_hash_table_remove(cache->entries, GUINT_TO_POINTER(entry->index));
+  g_queue_delete_link(&cache->lru, link);
+  cache->stats.size -= entry->size;
+  cache->stats.entries--;
+  cache_entry_free(entry);
+}
+
+cb_cache_t*
+cb_cache_new(size_t budget)
+{
+  cb_cache_t* cache = g_malloc0(sizeof(cb_cache_t));
+
+  g_mutex_init(&cache->lock);
+  cache->entries = g_hash_table_new(g_direct_hash, g_direct_equal);
+  g_queue_init(&cache->lru);
+  cache->stats.budget = budget;
+
+  return cache;
+}
+
+void
+cb_cache_free(cb_cache_t* cache)
+{
+  if (cache == NULL) {
+    return;
+  }
+
+  g_queue_clear_full(&cache->lru, (GDestroyNotify) cache_entry_free);
+  g_hash_table_destroy(cache->entries);
+  g_mutex_clear(&cache->lock);
+  g_free(cache);
+}
+
+cairo_surface_t*
+cb_cache_lookup(cb_cache_t* cache, unsigned int index, unsigned int level)
+{
+  if (cache == NULL) {
+    return NULL;
+  }
+
+  cairo_surface_t* surface = NULL;
+
+  g_mutex_lock(&cache->lock);
+  GList* link = g_hash_table_lookup(cache->entries, GUINT_TO_POINTER(index));
+  cb_cache_entry_t* entry = link != NULL ? link->data : NULL;
+  if (entry != NULL && entry->level <= level) {
+    g_queue_unlink(&cache->lru, link);
+    g_queue_push_head_link(&cache->lru, link);
+    surface = cairo_surface_reference(entry->surface);
+    cache->stats.hits++;
+  } else {
+    cache->stats.misses++;
+  }
+  g_mutex_unlock(&cache->lock);
+
+  return surface;
+}
+
+bool
+cb_cache_contains(cb_cache_t* cache, unsigned int index, unsigned int level)
+{
+  if (cache == NULL) {
+    return false;
+  }
+
+  g_mutex_lock(&cache->lock);
+  GList* link = g_hash_table_lookup(cache->entries, GUINT_TO_POINTER(index));
+  const bool result = link != NULL && ((cb_cache_entry_t*) link->data)->level <= level;
+  g_mutex_unlock(&cache->lock);
+
+  return result;
+}
+
+void
+cb_cache_insert(cb_cache_t* cache, unsigned int index, unsigned int level,
+    cairo_surface_t* surface)
+{
+  if (cache == NULL || surface == NULL) {
+    return;
+  }
+
+  const size_t size = surface_size(surface);
+  if (size > cache->stats.budget) {
+    return;
+  }
+
+  g_mutex_lock(&cache->lock);
+
+  /* replace a coarser version of the page, but keep one that is at least as
+   * fine */
+  GList* link = g_hash_table_lookup(cache->entries, GUINT_TO_POINTER(index));
+  if (link != NULL && ((cb_cache_entry_t*) link->data)->level <= level) {
+    g_mutex_unlock(&cache->lock);
+    return;
+  }
+  if (link != NULL) {
+    cache_remove_link(cache, link);
+  }
+
+  while (cache->stats.size + size > cache->stats.budget) {
+    cache_remove_link(cache, g_queue_peek_tail_link(&cache->lru));
+    cache->stats.evictions++;
+  }
+
+  cb_cache_entry_t* entry = g_malloc0(sizeof(cb_cache_entry_t));
+  entry->index = index;
+  entry->level = level;
+  entry->surface = cairo_surface_reference(surface);
+  entry->size = size;
+
+  g_queue_push_head(&cache->lru, entry);
+  g_hash_table_insert(cache->entries, GUINT_TO_POINTER(index), g_queue_peek_head_link(&cache->lru));
+  cache->stats.size += size;
+  cache->stats.entries++;
+
+  g_mutex_unlock(&cache->lock);
+}
+
+void
+cb_cache_get_stats(cb_cache_t* cache, cb_cache_stats_t* stats)
+{
+  if (cache == NULL || stats == NULL) {
+    return;
+  }
+
+  g_mutex_lock(&cache->lock);
+  *stats = cache->stats;
+  g_mutex_unlock(&cache->lock);
+}
@@ -0,0 +1,89 @@
+/* See LICENSE file for license and copyright information */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <cairo.h>
+
+#include <girara/macros.h>
+
+typedef struct cb_cache_s cb_cache_t;
+
+/** Statistics of a page cache
+ */
+typedef struct cb_cache_stats_s {
+  size_t hits; /**< Number of successful lookups */
+  size_t misses; /**< Number of failed lookups */
+  size_t evictions; /**< Number of surfaces dropped to stay within the budget */
+  size_t size; /**< Bytes currently held */
+  size_t budget; /**< Maximum number of bytes held */
+  unsigned int entries; /**< Number of surfaces currently held */
+} cb_cache_stats_t;
+
+/**
+ * Creates a new cache of decoded pages. The cache is safe to use from
+ * multiple threads.
+ *
+ * @param budget Maximum number of bytes of image data to keep
+ * @return The cache
+ */
+GIRARA_HIDDEN cb_cache_t* cb_cache_new(size_t budget);
+
+/**
+ * Frees the cache and releases all surfaces held by it
+ *
+ * @param cache The cache
+ */
+GIRARA_HIDDEN void cb_cache_free(cb_cache_t* cache);
+
+/**
+ * Looks up the surface of a page and marks it as most recently used. Pages
+ * are decoded at reduced sizes (see CB_MAX_SCALE_LEVEL), so a surface is only
+ * returned if it has at least the requested resolution.
+ *
+ * @param cache The cache
+ * @param index Page index
+ * @param level Scale level needed; the image is reduced by a factor of 2^level
+ * @return A new reference to the surface or NULL if the page is not cached
+ *   at the requested level or a finer one
+ */
+GIRARA_HIDDEN cairo_surface_t* cb_cache_lookup(cb_cache_t* cache, unsigned int index,
+    unsigned int level);
+
+/**
+ * Checks whether a page is cached without affecting the statistics or the
+ * eviction order
+ *
+ * @param cache The cache
+ * @param index Page index
+ * @param level Scale level needed
+ * @return true if the page is cached at the requested level or a finer one
+ */
+GIRARA_HIDDEN bool cb_cache_contains(cb_cache_t* cache, unsigned int index, unsigned int level);
+
+/**
+ * Adds the surface of a page to the cache, replacing a coarser version of the
+ * page and evicting the least recently used pages if the budget is exceeded.
+ * If the page is already cached at the same or a finer level, e.g. because
+ * it was rendered while it was being read ahead, the cache is left as it
+ * is. Surfaces larger than the budget are not cached.
+ *
+ * @param cache The cache
+ * @param index Page index
+ * @param level Scale level of the surface
+ * @param surface Image surface of the page; the cache takes its own reference
+ */
+GIRARA_HIDDEN void cb_cache_insert(cb_cache_t* cache, unsigned int index, unsigned int level,
+    cairo_surface_t* surface);
+
+/**
+ * Retrieves the statistics of the cache
+ *
+ * @param cache The cache
+ * @param stats Set to the current statistics
+ */
+GIRARA_HIDDEN void cb_cache_get_stats(cb_cache_t* cache, cb_cache_stats_t* stats);
+
+#endif // CACHE_H
@@ -0,0 +1,254 @@
+/* See LICENSE file for license and copyright information */
+
+#include <glib.h>
+
+#include "convert.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define CB_CONVERT_X86 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#define CB_CONVERT_NEON 1
+#include <arm_neon.h>
+#endif
+
+typedef void (*convert_function_t)(const uint8_t* src, uint32_t* dst, size_t pixels);
+
+/* (x * a) / 255 rounded, exact for all 8 bit x and a */
+static inline uint32_t
+multiply_alpha(uint32_t x, uint32_t a)
+{
+  const uint32_t t = x * a + 128;
+  return (t + (t >> 8)) >> 8;
+}
+
+static void
+rgb_to_xrgb_scalar(const uint8_t* src, uint32_t* dst, size_t pixels)
+{
+  for (size_t i = 0; i < pixels; i++, src += 3) {
+    dst[i] = 0xff000000u | ((uint32_t) src[0] << 16) | ((uint32_t) src[1] << 8) | src[2];
+  }
+}
+
+static void
+rgba_to_argb_scalar(const uint8_t* src, uint32_t* dst, size_t pixels)
+{
+  for (size_t i = 0; i < pixels; i++, src += 4) {
+    const uint32_t a = src[3];
+    if (a == 0xff) {
+      dst[i] = 0xff000000u | ((uint32_t) src[0] << 16) | ((uint32_t) src[1] << 8) | src[2];
+    } else if (a == 0) {
+      dst[i] = 0;
+    } else {
+      dst[i] = (a << 24) | (multiply_alpha(src[0], a) << 16)
+        | (multiply_alpha(src[1], a) << 8) | multiply_alpha(src[2], a);
+    }
+  }
+}
+
+#ifdef CB_CONVERT_X86
+/* The vector kernels rely on the little endian layout of x86, where a native
+ * 0xAARRGGBB pixel is stored as B, G, R, A. */
+
+__attribute__((target("ssse3"))) static void
+rgb_to_xrgb_ssse3(const uint8_t* src, uint32_t* dst, size_t pixels)
+{
+  const __m128i shuffle = _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+  const __m128i alpha = _mm_set1_epi32((int) 0xff000000u);
+
+  /* 4 pixels per step; each load reads 16 of the 12 bytes, so stop early */
+  size_t i = 0;
+  for (; i + 6 <= pixels; i += 4) {
+    const __m128i rgb = _mm_loadu_si128((const __m128i*) (src + i * 3));
+    _mm_storeu_si128((__m128i*) (dst + i), _mm_or_si128(_mm_shuffle_epi8(rgb, shuffle), alpha));
+  }
+
+  rgb_to_xrgb_scalar(src + i * 3, dst + i, pixels - i);
+}
+
+__attribute__((target("avx2"))) static void
+rgb_to_xrgb_avx2(const uint8_t* src, uint32_t* dst, size_t pixels)
+{
+  const __m256i shuffle = _mm256_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1,
+      2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+  const __m256i alpha = _mm256_set1_epi32((int) 0xff000000u);
+
+  /* 8 pixels per step, 4 in each 128 bit lane */
+  size_t i = 0;
+  for (; i + 10 <= pixels; i += 8) {
+    const __m128i low = _mm_loadu_si128((const __m128i*) (src + i * 3));
+    const __m128i high = _mm_loadu_si128((const __m128i*) (src + i * 3 + 12));
+    const __m256i rgb = _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+    _mm256_storeu_si256((__m256i*) (dst + i),
+        _mm256_or_si256(_mm256_shuffle_epi8(rgb, shuffle), alpha));
+  }
+
+  rgb_to_xrgb_scalar(src + i * 3, dst + i, pixels - i);
+}
+
+__attribute__((target("sse2"))) static inline __m128i
+premultiply_sse2(__m128i rgba, __m128i alpha_mask)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i bias = _mm_set1_epi16(128);
+
+  /* two pixels per half, 16 bits per channel */
+  __m128i lo = _mm_unpacklo_epi8(rgba, zero);
+  __m128i hi = _mm_unpackhi_epi8(rgba, zero);
+
+  /* swap R and B and broadcast A */
+  lo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, _MM_SHUFFLE(3, 0, 1, 2)), _MM_SHUFFLE(3, 0, 1, 2));
+  hi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, _MM_SHUFFLE(3, 0, 1, 2)), _MM_SHUFFLE(3, 0, 1, 2));
+  const __m128i alo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+  const __m128i ahi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+
+  __m128i tlo = _mm_add_epi16(_mm_mullo_epi16(lo, alo), bias);
+  __m128i thi = _mm_add_epi16(_mm_mullo_epi16(hi, ahi), bias);
+  tlo = _mm_srli_epi16(_mm_add_epi16(tlo, _mm_srli_epi16(tlo, 8)), 8);
+  thi = _mm_srli_epi16(_mm_add_epi16(thi, _mm_srli_epi16(thi, 8)), 8);
+
+  /* keep the original alpha */
+  const __m128i premultiplied = _mm_packus_epi16(tlo, thi);
+  return _mm_or_si128(_mm_andnot_si128(alpha_mask, premultiplied), _mm_and_si128(alpha_mask, rgba));
+}
+
+__attribute__((target("sse2"))) static void
+rgba_to_argb_sse2(const uint8_t* src, uint32_t* dst, size_t pixels)
+{
+  const __m128i alpha_mask = _mm_set1_epi32((int) 0xff000000u);
+
+  size_t i = 0;
+  for (; i + 4 <= pixels; i += 4) {
+    const __m128i rgba = _mm_loadu_si128((const __m128i*) (src + i * 4));
+    _mm_storeu_si128((__m128i*) (dst + i), premultiply_sse2(rgba, alpha_mask));
+  }
+
+  rgba_to_argb_scalar(src + i * 4, dst + i, pixels - i);
+}
+
+__attribute__((target("avx2"))) static void
+rgba_to_argb_avx2(const uint8_t* src, uint32_t* dst, size_t pixels)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i bias = _mm256_set1_epi16(128);
+  const __m256i alpha_mask = _mm256_set1_epi32((int) 0xff000000u);
+  const __m256i swap = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+      2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+  const __m256i broadcast = _mm256_setr_epi8(6, 7, 6, 7, 6, 7, 6, 7, 14, 15, 14, 15, 14, 15, 14, 15,
+      6, 7, 6, 7, 6, 7, 6, 7, 14, 15, 14, 15, 14, 15, 14, 15);
+
+  size_t i = 0;
+  for (; i + 8 <= pixels; i += 8) {
+    const __m256i rgba = _mm256_loadu_si256((const __m256i*) (src + i * 4));
+    const __m256i bgra = _mm256_shuffle_epi8(rgba, swap);
+
+    const __m256i lo = _mm256_unpacklo_epi8(bgra, zero);
+    const __m256i hi = _mm256_unpackhi_epi8(bgra, zero);
+    __m256i tlo = _mm256_add_epi16(_mm256_mullo_epi16(lo, _mm256_shuffle_epi8(lo, broadcast)), bias);
+    __m256i thi = _mm256_add_epi16(_mm256_mullo_epi16(hi, _mm256_shuffle_epi8(hi, broadcast)), bias);
+    tlo = _mm256_srli_epi16(_mm256_add_epi16(tlo, _mm256_srli_epi16(tlo, 8)), 8);
+    thi = _mm256_srli_epi16(_mm256_add_epi16(thi, _mm256_srli_epi16(thi, 8)), 8);
+
+    /* unpack and pack work per lane, so the pixel order is preserved */
+    const __m256i premultiplied = _mm256_packus_epi16(tlo, thi);
+    _mm256_storeu_si256((__m256i*) (dst + i), _mm256_or_si256(
+          _mm256_andnot_si256(alpha_mask, premultiplied), _mm256_and_si256(alpha_mask, bgra)));
+  }
+
+  rgba_to_argb_scalar(src + i * 4, dst + i, pixels - i);
+}
+#endif
+
+#ifdef CB_CONVERT_NEON
+static void
+rgb_to_xrgb_neon(const uint8_t* src, uint32_t* dst, size_t pixels)
+{
+  size_t i = 0;
+  for (; i + 16 <= pixels; i += 16) {
+    const uint8x16x3_t rgb = vld3q_u8(src + i * 3);
+    uint8x16x4_t bgrx;
+    bgrx.val[0] = rgb.val[2];
+    bgrx.val[1] = rgb.val[1];
+    bgrx.val[2] = rgb.val[0];
+    bgrx.val[3] = vdupq_n_u8(0xff);
+    vst4q_u8((uint8_t*) (dst + i), bgrx);
+  }
+
+  rgb_to_xrgb_scalar(src + i * 3, dst + i, pixels - i);
+}
+
+static inline uint8x8_t
+multiply_alpha_neon(uint8x8_t x, uint8x8_t a)
+{
+  const uint16x8_t t = vmull_u8(x, a);
+  return vraddhn_u16(t, vrshrq_n_u16(t, 8));
+}
+
+static void
+rgba_to_argb_neon(const uint8_t* src, uint32_t* dst, size_t pixels)
+{
+  size_t i = 0;
+  for (; i + 8 <= pixels; i += 8) {
+    const uint8x8x4_t rgba = vld4_u8(src + i * 4);
+    uint8x8x4_t bgra;
+    bgra.val[0] = multiply_alpha_neon(rgba.val[2], rgba.val[3]);
+    bgra.val[1] = multiply_alpha_neon(rgba.val[1], rgba.val[3]);
+    bgra.val[2] = multiply_alpha_neon(rgba.val[0], rgba.val[3]);
+    bgra.val[3] = rgba.val[3];
+    vst4_u8((uint8_t*) (dst + i), bgra);
+  }
+
+  rgba_to_argb_scalar(src + i * 4, dst + i, pixels - i);
+}
+#endif
+
+typedef struct convert_functions_s {
+  convert_function_t rgb_to_xrgb;
+  convert_function_t rgba_to_argb;
+} convert_functions_t;
+
+static const convert_functions_t*
+get_convert_functions(void)
+{
+  static convert_functions_t functions;
+  static gsize initialized = 0;
+
+  if (g_once_init_enter(&initialized)) {
+    functions.rgb_to_xrgb = rgb_to_xrgb_scalar;
+    functions.rgba_to_argb = rgba_to_argb_scalar;
+
+#if defined(CB_CONVERT_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+      functions.rgb_to_xrgb = rgb_to_xrgb_avx2;
+      functions.rgba_to_argb = rgba_to_argb_avx2;
+    } else {
+      if (__builtin_cpu_supports("ssse3")) {
+        functions.rgb_to_xrgb = rgb_to_xrgb_ssse3;
+      }
+      if (__builtin_cpu_supports("sse2")) {
+        functions.rgba_to_argb = rgba_to_argb_sse2;
+      }
+    }
+#elif defined(CB_CONVERT_NEON)
+    functions.rgb_to_xrgb = rgb_to_xrgb_neon;
+    functions.rgba_to_argb = rgba_to_argb_neon;
+#endif
+
+    g_once_init_leave(&initialized, 1);
+  }
+
+  return &functions;
+}
+
+void
+cb_convert_rgb_to_xrgb(const uint8_t* src, uint32_t* dst, size_t pixels)
+{
+  get_convert_functions()->rgb_to_xrgb(src, dst, pixels);
+}
+
+void
+cb_convert_rgba_to_argb(const uint8_t* src, uint32_t* dst, size_t pixels)
+{
+  get_convert_functions()->rgba_to_argb(src, dst, pixels);
+}
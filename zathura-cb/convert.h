@@ -0,0 +1,32 @@
+/* See LICENSE file for license and copyright information */
+
+#ifndef CONVERT_H
+#define CONVERT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <girara/macros.h>
+
+/**
+ * Converts packed 8 bit RGB pixels to cairo's CAIRO_FORMAT_RGB24 layout
+ * (native endian 0xffRRGGBB)
+ *
+ * @param src Source pixels, 3 bytes each
+ * @param dst Destination pixels
+ * @param pixels Number of pixels
+ */
+GIRARA_HIDDEN void cb_convert_rgb_to_xrgb(const uint8_t* src, uint32_t* dst, size_t pixels);
+
+/**
+ * Converts packed 8 bit RGBA pixels to cairo's CAIRO_FORMAT_ARGB32 layout
+ * (native endian 0xAARRGGBB with premultiplied alpha). The conversion may be
+ * done in place, with src and dst pointing to the same pixels.
+ *
+ * @param src Source pixels, 4 bytes each
+ * @param dst Destination pixels
+ * @param pixels Number of pixels
+ */
+GIRARA_HIDDEN void cb_convert_rgba_to_argb(const uint8_t* src, uint32_t* dst, size_t pixels);
+
+#endif // CONVERT_H
@@ -0,0 +1,103 @@
+/* See LICENSE file for license and copyright information */
+
+#include <glib.h>
+#include <string.h>
+
+#include "decode.h"
+#include "scale.h"
+#ifdef CB_WITH_TURBOJPEG
+#include "jpeg.h"
+#endif
+#ifdef CB_WITH_PNG
+#include "pngdec.h"
+#endif
+#ifdef CB_WITH_JXL
+#include "jxl.h"
+#endif
+#ifdef CB_WITH_AVIF
+#include "avif.h"
+#endif
+
+/** Formats recognized by their signature
+ */
+typedef enum image_type_e {
+  IMAGE_TYPE_UNKNOWN,
+  IMAGE_TYPE_JPEG,
+  IMAGE_TYPE_PNG,
+  IMAGE_TYPE_JXL,
+  IMAGE_TYPE_AVIF
+} image_type_t;
+
+static image_type_t
+get_image_type(const unsigned char* data)
+{
+  if (memcmp(data, "\xff\xd8\xff", 3) == 0) {
+    return IMAGE_TYPE_JPEG;
+  } else if (memcmp(data, "\x89PNG\r\n\x1a\n", 8) == 0) {
+    return IMAGE_TYPE_PNG;
+  } else if (memcmp(data, "\xff\x0a", 2) == 0 || memcmp(data, "\0\0\0\x0cJXL ", 8) == 0) {
+    return IMAGE_TYPE_JXL;
+  } else if (memcmp(data + 4, "ftyp", 4) == 0) {
+    return IMAGE_TYPE_AVIF;
+  }
+
+  return IMAGE_TYPE_UNKNOWN;
+}
+
+static cairo_surface_t*
+reduce_surface(cairo_surface_t* surface, unsigned int level)
+{
+  if (surface == NULL || level == 0) {
+    return surface;
+  }
+
+  /* formats that cannot be decoded at a reduced size are scaled down
+   * afterwards, so that they take the same room in the cache as the
+   * gdk-pixbuf path */
+  const int width = MAX(cairo_image_surface_get_width(surface) >> level, 1);
+  const int height = MAX(cairo_image_surface_get_height(surface) >> level, 1);
+  cairo_surface_t* scaled = cb_scale_surface(surface, width, height);
+  if (scaled == NULL) {
+    return surface;
+  }
+
+  cairo_surface_destroy(surface);
+  return scaled;
+}
+
+cairo_surface_t*
+cb_decode_image(const void* data, size_t size, unsigned int level, bool verified G_GNUC_UNUSED,
+    unsigned int threads G_GNUC_UNUSED)
+{
+  if (data == NULL || size < 8) {
+    return NULL;
+  }
+
+  /* each image goes to at most one decoder, the one of its signature */
+  cairo_surface_t* surface = NULL;
+  switch (get_image_type(data)) {
+#ifdef CB_WITH_TURBOJPEG
+    case IMAGE_TYPE_JPEG:
+      return cb_jpeg_decode(data, size, level);
+#endif
+#ifdef CB_WITH_PNG
+    case IMAGE_TYPE_PNG:
+      surface = cb_png_decode(data, size, verified);
+      break;
+#endif
+#ifdef CB_WITH_JXL
+    case IMAGE_TYPE_JXL:
+      surface = cb_jxl_decode(data, size, threads);
+      break;
+#endif
+#ifdef CB_WITH_AVIF
+    case IMAGE_TYPE_AVIF:
+      surface = cb_avif_decode(data, size, threads);
+      break;
+#endif
+    default:
+      break;
+  }
+
+  return reduce_surface(surface, level);
+}
@@ -0,0 +1,30 @@
+/* See LICENSE file for license and copyright information */
+
+#ifndef DECODE_H
+#define DECODE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <cairo.h>
+
+#include <girara/macros.h>
+
+/**
+ * Decodes an image with one of the decoders built into the plugin, straight
+ * into a cairo image surface. The format is recognized by its signature;
+ * formats without a built-in decoder are left to gdk-pixbuf.
+ *
+ * @param data The encoded image
+ * @param size Size of the encoded image
+ * @param level Scale level; the image is decoded at, or else reduced to,
+ *   1/2^level of its size
+ * @param verified Whether the data has already been checked against a
+ *   checksum, so that the decoders may skip the checksums of the format
+ * @param threads Number of threads the decoders may use for the image
+ * @return A CAIRO_FORMAT_RGB24 or CAIRO_FORMAT_ARGB32 image surface, or NULL
+ *   if there is no decoder for the image or it could not be decoded
+ */
+GIRARA_HIDDEN cairo_surface_t* cb_decode_image(const void* data, size_t size, unsigned int level,
+    bool verified, unsigned int threads);
+
+#endif // DECODE_H
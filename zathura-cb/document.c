@@ -7,17 +7,32 @@
 #include <gtk/gtk.h>
 #include <glib/gstdio.h>
 #include <girara/datastructures.h>
+#include <girara/log.h>
 #include <archive.h>
 #include <archive_entry.h>
 
 #include "plugin.h"
 #include "internal.h"
+#include "metadata.h"
+#include "probe.h"
+#include "reader.h"
+#include "trace.h"
 #include "utils.h"
 
-static int compare_pages(const cb_document_page_meta_t* page1, const cb_document_page_meta_t* page2);
-static bool read_archive(cb_document_t* cb_document, const char* archive, girara_list_t* supported_extensions);
+static int compare_pages(const void* data1, const void* data2);
+static bool read_archive(cb_document_t* cb_document, girara_list_t* supported_extensions,
+    bool fast_open);
+static bool read_zip(cb_document_t* cb_document, girara_list_t* supported_extensions,
+    bool fast_open);
+static gpointer probe_page_sizes(gpointer data);
+static bool probe_zip_entry_size(cb_zip_t* zip, unsigned int position, int* width, int* height);
+static void remove_unprobed_pages(cb_document_t* cb_document);
+static bool can_probe_in_parallel(struct archive* a);
+static void probe_pages_in_parallel(cb_document_t* cb_document, unsigned int threads);
 static char* get_extension(const char* path);
-static void cb_document_page_meta_free(cb_document_page_meta_t* meta);
+static void append_extension(girara_list_t* extensions, const char* extension);
+static void cb_document_page_meta_clear(cb_document_page_meta_t* meta);
+static bool is_seekable_format(int format);
 
 zathura_error_t
 cb_document_open(zathura_document_t* document)
@@ -26,7 +41,8 @@ cb_document_open(zathura_document_t* document)
     return ZATHURA_ERROR_INVALID_ARGUMENTS;
   }
 
-  cb_document_t* cb_document = g_malloc0(sizeof(cb_document));
+  cb_document_t* cb_document = g_malloc0(sizeof(cb_document_t));
+  g_mutex_init(&cb_document->size_lock);
 
   /* archive path */
   const char* path = zathura_document_get_path(document);
@@ -43,29 +59,119 @@ cb_document_open(zathura_document_t* document)
     char** extensions = gdk_pixbuf_format_get_extensions(format);
 
     for (unsigned int i = 0; extensions[i] != NULL; i++) {
-      girara_list_append(supported_extensions, g_strdup(extensions[i]));
+      append_extension(supported_extensions, extensions[i]);
     }
 
     g_strfreev(extensions);
   }
   g_slist_free(formats);
 
-  /* create list of supported files (pages) */
-  cb_document->pages = girara_sorted_list_new2((girara_compare_function_t)
-      compare_pages, (girara_free_function_t) cb_document_page_meta_free);
-  if (cb_document->pages == NULL) {
+  /* formats decoded by the plugin itself */
+#ifdef CB_WITH_JXL
+  append_extension(supported_extensions, "jxl");
+#endif
+#ifdef CB_WITH_AVIF
+  append_extension(supported_extensions, "avif");
+#endif
+
+  /* create array of supported files (pages) */
+  cb_document->pages = g_array_new(FALSE, TRUE, sizeof(cb_document_page_meta_t));
+  g_array_set_clear_func(cb_document->pages, (GDestroyNotify) cb_document_page_meta_clear);
+
+  /* open archive file */
+  cb_document->source = cb_source_new(path, get_env_uint("ZATHURA_CB_MMAP", 1) != 0);
+  if (cb_document->source == NULL) {
     goto error_free;
   }
 
-  /* read files recursively */
-  if (read_archive(cb_document, path, supported_extensions) == false) {
-    goto error_free;
+  /* zip archives are listed and read through their central directory */
+  if (get_env_uint("ZATHURA_CB_NATIVE_ZIP", 1) != 0) {
+    cb_document->zip = cb_zip_open(cb_document->source);
+  }
+
+  /* decode JPEG, PNG, JPEG XL and AVIF images without gdk-pixbuf if the
+   * plugin is built with the libraries for it */
+  cb_document->native_decode = get_env_uint("ZATHURA_CB_NATIVE_DECODE", 1) != 0;
+
+  /* the displayed page and the read-ahead workers are decoded at the same
+   * time, so every decoder that uses threads of its own gets its share of
+   * the processors */
+  const unsigned int prefetch_pages = get_env_uint("ZATHURA_CB_PREFETCH_PAGES", CB_PREFETCH_PAGES_DEFAULT);
+  const unsigned int prefetch_threads = prefetch_pages > 0
+    ? get_env_uint("ZATHURA_CB_PREFETCH_THREADS", CB_PREFETCH_THREADS_DEFAULT) : 0;
+  cb_document->decode_threads = MAX(g_get_num_processors() / (prefetch_threads + 1), 1);
+
+  /* reuse the page list and page renditions of previous runs if the archive
+   * did not change */
+  const bool metadata_cache = get_env_uint("ZATHURA_CB_METADATA_CACHE", 1) != 0;
+  const bool thumbnail_cache = get_env_uint("ZATHURA_CB_THUMBNAIL_CACHE", 1) != 0;
+  if (metadata_cache == true || thumbnail_cache == true) {
+    cb_document->metadata = cb_metadata_new(path, cb_document->source, supported_extensions);
+  }
+  if (thumbnail_cache == true) {
+    const size_t thumbnail_cache_size = get_env_uint("ZATHURA_CB_THUMBNAIL_CACHE_SIZE",
+        CB_THUMBNAIL_CACHE_SIZE_DEFAULT);
+    cb_document->thumbnails = cb_thumbnails_new(cb_metadata_get_fingerprint(cb_document->metadata),
+        thumbnail_cache_size * 1024 * 1024);
+  }
+  if (metadata_cache == false) {
+    cb_metadata_free(cb_document->metadata);
+    cb_document->metadata = NULL;
+  }
+
+  if (cb_metadata_load(cb_document->metadata, cb_document) == false) {
+    /* read files recursively */
+    const bool fast_open = get_env_uint("ZATHURA_CB_FAST_OPEN", 0) != 0;
+    if (cb_document->zip != NULL && read_zip(cb_document, supported_extensions, fast_open) == false) {
+      /* let libarchive deal with entries that cannot be read directly */
+      g_array_set_size(cb_document->pages, 0);
+      cb_zip_free(cb_document->zip);
+      cb_document->zip = NULL;
+    }
+
+    if (cb_document->zip == NULL) {
+      cb_source_advise(cb_document->source, CB_SOURCE_ACCESS_SEQUENTIAL);
+      if (read_archive(cb_document, supported_extensions, fast_open) == false) {
+        goto error_free;
+      }
+    }
+
+    /* the pages are collected in archive order, sort them once */
+    g_array_sort(cb_document->pages, compare_pages);
+
+    if (fast_open == false) {
+      cb_metadata_save(cb_document->metadata, cb_document);
+    } else if (cb_document->pages->len > 0) {
+      /* resolve the real page sizes in the background; the page list is
+       * stored once they are known */
+      cb_document->probe_thread = g_thread_try_new("cb-probe", probe_page_sizes, cb_document, NULL);
+    }
   }
 
   girara_list_free(supported_extensions);
 
+  /* keep the archive open for reading pages; unless the archive can only be
+   * read as a stream, pages are read in arbitrary order from now on */
+  const size_t spool_memory = get_env_uint("ZATHURA_CB_SPOOL_MEMORY", CB_SPOOL_MEMORY_DEFAULT);
+  const unsigned int readers = get_env_uint("ZATHURA_CB_READERS", g_get_num_processors());
+  cb_document->reader = cb_reader_new(cb_document->source, cb_document->zip, cb_document->pages,
+      cb_document->archive_format, cb_document->archive_filter, readers,
+      spool_memory * 1024 * 1024);
+  if (cb_document->probe_thread == NULL && is_seekable_format(cb_document->archive_format) == true) {
+    cb_source_advise(cb_document->source, CB_SOURCE_ACCESS_RANDOM);
+  }
+
+  /* create cache of decoded pages */
+  const size_t cache_size = get_env_uint("ZATHURA_CB_CACHE_SIZE", CB_CACHE_SIZE_DEFAULT);
+  cb_document->cache = cb_cache_new(cache_size * 1024 * 1024);
+
+  /* start read-ahead workers */
+  const unsigned int number_of_pages = cb_document->pages->len;
+  cb_document->prefetch = cb_prefetch_new(cb_document, number_of_pages, prefetch_pages,
+      prefetch_threads);
+
   /* set document information */
-  zathura_document_set_number_of_pages(document, girara_list_size(cb_document->pages));
+  zathura_document_set_number_of_pages(document, number_of_pages);
   zathura_document_set_data(document, cb_document);
 
   return ZATHURA_ERROR_OK;
@@ -86,65 +192,215 @@ cb_document_free(zathura_document_t* UNUSED(document), void* data)
     return ZATHURA_ERROR_INVALID_ARGUMENTS;
   }
 
-  /* remove page list */
+  /* stop background work before the pages go away */
+  if (cb_document->probe_thread != NULL) {
+    g_atomic_int_set(&cb_document->probe_cancel, 1);
+    g_thread_join(cb_document->probe_thread);
+  }
+  cb_prefetch_free(cb_document->prefetch);
+
+  cb_reader_free(cb_document->reader);
+  cb_zip_free(cb_document->zip);
+  cb_source_free(cb_document->source);
+  cb_metadata_free(cb_document->metadata);
+  cb_thumbnails_free(cb_document->thumbnails);
+
+  /* remove page array */
   if (cb_document->pages != NULL) {
-    girara_list_free(cb_document->pages);
+    g_array_free(cb_document->pages, TRUE);
+  }
+
+  /* remove page cache */
+  if (cb_document->cache != NULL) {
+    cb_cache_stats_t stats;
+    cb_cache_get_stats(cb_document->cache, &stats);
+    girara_debug("page cache: %zu hits, %zu misses, %zu evictions",
+        stats.hits, stats.misses, stats.evictions);
+    cb_cache_free(cb_document->cache);
   }
 
+  g_mutex_clear(&cb_document->size_lock);
+
   g_free(cb_document);
 
+  CB_TRACE_FLUSH();
+
   return ZATHURA_ERROR_OK;
 }
 
+static bool
+is_seekable_format(int format)
+{
+  switch (format & ARCHIVE_FORMAT_BASE_MASK) {
+    case ARCHIVE_FORMAT_ZIP:
+    case ARCHIVE_FORMAT_7ZIP:
+    case ARCHIVE_FORMAT_TAR:
+      return true;
+    default:
+      return false;
+  }
+}
+
 static void
-cb_document_page_meta_free(cb_document_page_meta_t* meta)
+cb_document_page_meta_clear(cb_document_page_meta_t* meta)
 {
   if (meta == NULL) {
     return;
   }
 
-  if (meta->file != NULL) {
-    g_free(meta->file);
-  }
-  g_free(meta);
+  g_free(meta->file);
+  g_free(meta->sort_key);
+  meta->file = NULL;
+  meta->sort_key = NULL;
 }
 
+typedef struct pixbuf_size_s {
+  int width;
+  int height;
+} pixbuf_size_t;
+
 static void
 get_pixbuf_size(GdkPixbufLoader* loader, int width, int height, gpointer data)
 {
-  cb_document_page_meta_t* meta = (cb_document_page_meta_t*)data;
+  pixbuf_size_t* size = data;
 
-  meta->width = width;
-  meta->height = height;
+  size->width = width;
+  size->height = height;
 
   gdk_pixbuf_loader_set_size(loader, 0, 0);
 }
 
 static bool
-read_archive(cb_document_t* cb_document, const char* archive, girara_list_t* supported_extensions)
+probe_entry_size_with_loader(struct archive* a, const void* header, size_t header_size,
+    int* width, int* height)
 {
-  struct archive* a = archive_read_new();
-  if (a == NULL) {
+  pixbuf_size_t image_size = { 0, 0 };
+
+  GdkPixbufLoader* loader = gdk_pixbuf_loader_new();
+  g_signal_connect(loader, "size-prepared", G_CALLBACK(get_pixbuf_size), &image_size);
+
+  /* feed the data that has already been read for the native probe; without
+   * an archive, that is all there is */
+  bool ok = header_size == 0 || gdk_pixbuf_loader_write(loader, header, header_size, NULL) == true;
+  ok = ok == true && a != NULL;
+
+  int r = 0;
+  size_t size = 0;
+  const void* buf = NULL;
+  __LA_INT64_T offset = 0;
+  while (ok == true && (image_size.width <= 0 || image_size.height <= 0)
+      && (r = archive_read_data_block(a, &buf, &size, &offset)) != ARCHIVE_EOF) {
+    if (r < ARCHIVE_WARN) {
+      break;
+    }
+
+    if (buf == NULL || size <= 0) {
+      continue;
+    }
+
+    if (gdk_pixbuf_loader_write(loader, buf, size, NULL) == false) {
+      break;
+    }
+  }
+
+  gdk_pixbuf_loader_close(loader, NULL);
+  g_object_unref(loader);
+
+  if (image_size.width <= 0 || image_size.height <= 0) {
     return false;
   }
 
-  archive_read_support_filter_all(a);
-  archive_read_support_format_all(a);
-  int r = archive_read_open_filename(a, archive, (size_t) LIBARCHIVE_BUFFER_SIZE);
-  if (r != ARCHIVE_OK) {
-    archive_read_free(a);
+  *width = image_size.width;
+  *height = image_size.height;
+  return true;
+}
+
+static bool
+probe_entry_size(struct archive* a, int* width, int* height)
+{
+  /* Parse the image header directly; the first block usually contains all of
+   * it, so it is only copied if more data is needed. */
+  unsigned char* header = NULL;
+  size_t header_size = 0;
+  cb_probe_result_t result = CB_PROBE_NEED_MORE_DATA;
+
+  int r = 0;
+  size_t size = 0;
+  const void* buf = NULL;
+  __LA_INT64_T offset = 0;
+  while (result == CB_PROBE_NEED_MORE_DATA && header_size < CB_PROBE_MAX_HEADER_SIZE
+      && (r = archive_read_data_block(a, &buf, &size, &offset)) != ARCHIVE_EOF) {
+    if (r < ARCHIVE_WARN) {
+      g_free(header);
+      return false;
+    }
+
+    if (buf == NULL || size <= 0) {
+      continue;
+    }
+
+    const bool first_block = header_size == 0;
+    if (first_block == true) {
+      result = cb_probe_image_size(buf, size, width, height);
+      if (result == CB_PROBE_OK) {
+        break;
+      }
+    }
+
+    header = g_realloc(header, header_size + size);
+    memcpy(header + header_size, buf, size);
+    header_size += size;
+
+    if (first_block == false) {
+      result = cb_probe_image_size(header, header_size, width, height);
+    }
+  }
+
+  if (result == CB_PROBE_OK) {
+    g_free(header);
+    return true;
+  }
+
+  /* unknown format or truncated header, let gdk-pixbuf have a go */
+  const bool found = probe_entry_size_with_loader(a, header, header_size, width, height);
+  g_free(header);
+
+  return found;
+}
+
+static bool
+read_archive(cb_document_t* cb_document, girara_list_t* supported_extensions,
+    bool fast_open)
+{
+  struct archive* a = cb_source_open_archive(cb_document->source, 0, false);
+  if (a == NULL) {
     return false;
   }
 
+  CB_TRACE_BEGIN(span, "read_archive");
+  int r = ARCHIVE_OK;
+
+  /* in archives whose entries can be reached independently of each other,
+   * the pages are only listed here and probed by several threads later */
+  const unsigned int probe_threads = get_env_uint("ZATHURA_CB_PROBE_THREADS", g_get_num_processors());
+  bool parallel_probe = false;
+
   struct archive_entry *entry = NULL;
+  unsigned int entry_count = 0;
   while ((r = archive_read_next_header(a, &entry)) != ARCHIVE_EOF) {
     if (r < ARCHIVE_WARN) {
       // let's ignore warnings ... they are non-fatal errors
+      CB_TRACE_END(span, "error", 1);
       archive_read_close(a);
       archive_read_free(a);
       return false;
     }
 
+    const unsigned int entry_index = entry_count++;
+    if (entry_index == 0 && fast_open == false) {
+      parallel_probe = probe_threads > 1 && can_probe_in_parallel(a) == true;
+    }
+
     if (archive_entry_filetype(entry) != AE_IFREG) {
       // we only care about regular files
       continue;
@@ -159,40 +415,29 @@ read_archive(cb_document_t* cb_document, const char* archive, girara_list_t* sup
 
     GIRARA_LIST_FOREACH(supported_extensions, char*, iter, ext)
       if (g_strcmp0(extension, ext) == 0) {
-        cb_document_page_meta_t* meta = g_malloc0(sizeof(cb_document_page_meta_t));
-        meta->file = g_strdup(path);
-
-        GdkPixbufLoader* loader = gdk_pixbuf_loader_new();
-        g_signal_connect(loader, "size-prepared", G_CALLBACK(get_pixbuf_size), meta);
-
-        size_t size = 0;
-        const void* buf = NULL;
-        __LA_INT64_T offset = 0;
-        while ((r = archive_read_data_block(a, &buf, &size, &offset)) != ARCHIVE_EOF) {
-          if (r < ARCHIVE_WARN) {
-            break;
-          }
-
-          if (buf == NULL || size <= 0) {
-            continue;
-          }
-
-          if (gdk_pixbuf_loader_write(loader, buf, size, NULL) == false) {
-            break;
-          }
-
-          if (meta->width > 0 && meta->height > 0) {
-            break;
+        cb_document_page_meta_t meta = {
+          .file = NULL,
+          .sort_key = NULL,
+          .entry = entry_index,
+          .header_offset = archive_read_header_position(a),
+          .size = archive_entry_size_is_set(entry) ? archive_entry_size(entry) : -1
+        };
+
+        bool is_page = true;
+        if (fast_open == true) {
+          /* only the first image in the archive is probed; its size is used
+           * for all pages until their real size is known */
+          if (cb_document->default_width == 0) {
+            probe_entry_size(a, &cb_document->default_width, &cb_document->default_height);
           }
+        } else if (parallel_probe == false) {
+          is_page = probe_entry_size(a, &meta.width, &meta.height);
         }
 
-        gdk_pixbuf_loader_close(loader, NULL);
-        g_object_unref(loader);
-
-        if (meta->width > 0 && meta->height > 0) {
-          girara_list_append(cb_document->pages, meta);
-        } else {
-          cb_document_page_meta_free(meta);
+        if (is_page == true) {
+          meta.file = g_strdup(path);
+          meta.sort_key = get_path_sort_key(path);
+          g_array_append_val(cb_document->pages, meta);
         }
 
         break;
@@ -202,15 +447,359 @@ read_archive(cb_document_t* cb_document, const char* archive, girara_list_t* sup
     g_free(extension);
   }
 
+  /* remember how the archive is stored, so that pages can be located later
+   * without scanning the whole archive again */
+  cb_document->archive_format = archive_format(a);
+  cb_document->archive_filter = archive_filter_code(a, 0);
+
   archive_read_close(a);
   archive_read_free(a);
+
+  if (parallel_probe == true) {
+    CB_TRACE_BEGIN(probe_span, "probe_pages");
+    probe_pages_in_parallel(cb_document, probe_threads);
+    CB_TRACE_END(probe_span, "threads", probe_threads);
+    remove_unprobed_pages(cb_document);
+  }
+
+  CB_TRACE_END(span, "pages", cb_document->pages->len);
+
   return true;
 }
 
+static bool
+read_zip(cb_document_t* cb_document, girara_list_t* supported_extensions, bool fast_open)
+{
+  CB_TRACE_BEGIN(span, "read_zip");
+  cb_zip_t* zip = cb_document->zip;
+
+  /* the central directory lists all pages without reading any data */
+  const unsigned int number_of_entries = cb_zip_get_number_of_entries(zip);
+  for (unsigned int i = 0; i < number_of_entries; i++) {
+    const cb_zip_entry_t* entry = cb_zip_get_entry(zip, i);
+    char* extension = get_extension(entry->name);
+    if (entry->is_file == false || extension == NULL) {
+      g_free(extension);
+      continue;
+    }
+
+    bool supported = false;
+    GIRARA_LIST_FOREACH(supported_extensions, char*, iter, ext)
+      if (g_strcmp0(extension, ext) == 0) {
+        supported = true;
+        break;
+      }
+    GIRARA_LIST_FOREACH_END(supported_extensions, char*, iter, ext);
+    g_free(extension);
+
+    if (supported == false) {
+      continue;
+    }
+
+    if (cb_zip_can_read_entry(entry) == false) {
+      CB_TRACE_END(span, "error", 1);
+      return false;
+    }
+
+    cb_document_page_meta_t meta = {
+      .file = g_strdup(entry->name),
+      .sort_key = get_path_sort_key(entry->name),
+      .entry = entry->position,
+      .header_offset = -1,
+      .size = entry->uncompressed_size
+    };
+    g_array_append_val(cb_document->pages, meta);
+  }
+
+  cb_document->archive_format = ARCHIVE_FORMAT_ZIP;
+  cb_document->archive_filter = ARCHIVE_FILTER_NONE;
+
+  if (fast_open == true) {
+    /* the size of the first page is used for all pages until their real
+     * size is known */
+    for (guint i = 0; i < cb_document->pages->len && cb_document->default_width <= 0; i++) {
+      const cb_document_page_meta_t* meta = &g_array_index(cb_document->pages, cb_document_page_meta_t, i);
+      probe_zip_entry_size(zip, meta->entry, &cb_document->default_width, &cb_document->default_height);
+    }
+  } else {
+    const unsigned int probe_threads = get_env_uint("ZATHURA_CB_PROBE_THREADS", g_get_num_processors());
+    probe_pages_in_parallel(cb_document, MAX(probe_threads, 1));
+    remove_unprobed_pages(cb_document);
+  }
+
+  CB_TRACE_END(span, "pages", cb_document->pages->len);
+
+  return true;
+}
+
+static void
+remove_unprobed_pages(cb_document_t* cb_document)
+{
+  /* entries that are not images after all are no pages */
+  for (guint i = cb_document->pages->len; i > 0; i--) {
+    const cb_document_page_meta_t* meta = &g_array_index(cb_document->pages, cb_document_page_meta_t, i - 1);
+    if (meta->width <= 0 || meta->height <= 0) {
+      g_array_remove_index(cb_document->pages, i - 1);
+    }
+  }
+}
+
+static bool
+probe_zip_entry_size(cb_zip_t* zip, unsigned int position, int* width, int* height)
+{
+  const cb_zip_entry_t* entry = cb_zip_get_entry_by_position(zip, position);
+
+  /* only the start of the entry is decompressed for the native probe */
+  size_t size = 0;
+  unsigned char* data = cb_zip_read_entry(zip, entry, CB_PROBE_MAX_HEADER_SIZE, &size);
+  if (data == NULL) {
+    return false;
+  }
+
+  if (cb_probe_image_size(data, size, width, height) == CB_PROBE_OK) {
+    g_free(data);
+    return true;
+  }
+
+  /* unknown format or truncated header, let gdk-pixbuf have a go */
+  if (size < entry->uncompressed_size) {
+    g_free(data);
+    data = cb_zip_read_entry(zip, entry, 0, &size);
+    if (data == NULL) {
+      return false;
+    }
+  }
+
+  const bool found = probe_entry_size_with_loader(NULL, data, size, width, height);
+  g_free(data);
+
+  return found;
+}
+
+static bool
+can_open_at_header(int format, int filter)
+{
+  /* see can_open_at_header in reader.c */
+  return filter == ARCHIVE_FILTER_NONE && (format & ARCHIVE_FORMAT_BASE_MASK) == ARCHIVE_FORMAT_TAR;
+}
+
+static bool
+can_probe_in_parallel(struct archive* a)
+{
+  const int format = archive_format(a);
+  const int filter = archive_filter_code(a, 0);
+
+  /* zip entries are compressed individually and skipping one only costs
+   * reading its header; uncompressed tar can be opened at any header */
+  return can_open_at_header(format, filter) == true
+    || (filter == ARCHIVE_FILTER_NONE && (format & ARCHIVE_FORMAT_BASE_MASK) == ARCHIVE_FORMAT_ZIP);
+}
+
+/** Pages probed by one thread of probe_pages_in_parallel
+ */
+typedef struct probe_range_s {
+  cb_document_t* cb_document; /**< The document */
+  guint first; /**< Index of the first page */
+  guint last; /**< Index after the last page */
+} probe_range_t;
+
+static gpointer
+probe_page_range(gpointer data)
+{
+  probe_range_t* range = data;
+  cb_document_t* cb_document = range->cb_document;
+
+  /* zip entries are read independently of each other */
+  if (cb_document->zip != NULL) {
+    for (guint i = range->first; i < range->last; i++) {
+      cb_document_page_meta_t* meta = &g_array_index(cb_document->pages, cb_document_page_meta_t, i);
+      probe_zip_entry_size(cb_document->zip, meta->entry, &meta->width, &meta->height);
+    }
+
+    return NULL;
+  }
+  const cb_document_page_meta_t* first = &g_array_index(cb_document->pages, cb_document_page_meta_t, range->first);
+
+  /* the pages are still in archive order, so each thread reads forward */
+  const bool at_header = first->header_offset >= 0
+    && can_open_at_header(cb_document->archive_format, cb_document->archive_filter) == true;
+  struct archive* a = cb_source_open_archive(cb_document->source,
+      at_header == true ? first->header_offset : 0, at_header);
+  if (a == NULL) {
+    return NULL;
+  }
+
+  struct archive_entry* entry = NULL;
+  unsigned int entry_index = at_header == true ? first->entry : 0;
+  for (guint i = range->first; i < range->last; entry_index++) {
+    if (archive_read_next_header(a, &entry) < ARCHIVE_WARN) {
+      break;
+    }
+
+    cb_document_page_meta_t* meta = &g_array_index(cb_document->pages, cb_document_page_meta_t, i);
+    if (meta->entry != entry_index) {
+      continue;
+    }
+    i++;
+
+    /* every thread writes to its own pages and nobody reads them until all
+     * threads are joined */
+    probe_entry_size(a, &meta->width, &meta->height);
+  }
+
+  archive_read_close(a);
+  archive_read_free(a);
+
+  return NULL;
+}
+
+static void
+probe_pages_in_parallel(cb_document_t* cb_document, unsigned int threads)
+{
+  const guint number_of_pages = cb_document->pages->len;
+  if (number_of_pages == 0) {
+    return;
+  }
+
+  const guint number_of_ranges = CLAMP(number_of_pages / CB_PROBE_PAGES_PER_THREAD_MIN, 1, threads);
+
+  probe_range_t* ranges = g_new0(probe_range_t, number_of_ranges);
+  GThread** workers = g_new0(GThread*, number_of_ranges);
+  for (guint i = 0; i < number_of_ranges; i++) {
+    ranges[i].cb_document = cb_document;
+    ranges[i].first = (guint64) number_of_pages * i / number_of_ranges;
+    ranges[i].last = (guint64) number_of_pages * (i + 1) / number_of_ranges;
+
+    /* the first range is probed by the calling thread */
+    if (i > 0) {
+      workers[i] = g_thread_try_new("cb-probe", probe_page_range, &ranges[i], NULL);
+    }
+  }
+
+  for (guint i = 0; i < number_of_ranges; i++) {
+    if (i == 0 || workers[i] == NULL) {
+      probe_page_range(&ranges[i]);
+    } else {
+      g_thread_join(workers[i]);
+    }
+  }
+
+  g_free(workers);
+  g_free(ranges);
+}
+
+bool
+cb_document_get_page_size(cb_document_t* cb_document, const cb_document_page_meta_t* meta,
+    int* width, int* height)
+{
+  g_mutex_lock(&cb_document->size_lock);
+  const bool known = meta->width > 0 && meta->height > 0;
+  if (known == true) {
+    *width = meta->width;
+    *height = meta->height;
+  } else {
+    *width = cb_document->default_width;
+    *height = cb_document->default_height;
+  }
+  g_mutex_unlock(&cb_document->size_lock);
+
+  return known;
+}
+
+static int
+compare_entries(const void* data1, const void* data2)
+{
+  const cb_document_page_meta_t* page1 = *(const cb_document_page_meta_t**) data1;
+  const cb_document_page_meta_t* page2 = *(const cb_document_page_meta_t**) data2;
+
+  return (page1->entry > page2->entry) - (page1->entry < page2->entry);
+}
+
+static gpointer
+probe_page_sizes(gpointer data)
+{
+  cb_document_t* cb_document = data;
+
+  if (cb_document->zip != NULL) {
+    guint i = 0;
+    for (; i < cb_document->pages->len && g_atomic_int_get(&cb_document->probe_cancel) == 0; i++) {
+      cb_document_page_meta_t* meta = &g_array_index(cb_document->pages, cb_document_page_meta_t, i);
+
+      int width = 0;
+      int height = 0;
+      if (probe_zip_entry_size(cb_document->zip, meta->entry, &width, &height) == true) {
+        g_mutex_lock(&cb_document->size_lock);
+        meta->width = width;
+        meta->height = height;
+        g_mutex_unlock(&cb_document->size_lock);
+      }
+    }
+
+    if (i == cb_document->pages->len) {
+      cb_metadata_save(cb_document->metadata, cb_document);
+    }
+
+    return NULL;
+  }
+
+  /* visit the pages in archive order, so that a single pass suffices */
+  GPtrArray* pages = g_ptr_array_sized_new(cb_document->pages->len);
+  for (guint i = 0; i < cb_document->pages->len; i++) {
+    g_ptr_array_add(pages, &g_array_index(cb_document->pages, cb_document_page_meta_t, i));
+  }
+  g_ptr_array_sort(pages, compare_entries);
+
+  struct archive* a = cb_source_open_archive(cb_document->source, 0, false);
+  if (a == NULL) {
+    g_ptr_array_free(pages, TRUE);
+    return NULL;
+  }
+
+  struct archive_entry* entry = NULL;
+  unsigned int entry_index = 0;
+  guint i = 0;
+  for (; i < pages->len && g_atomic_int_get(&cb_document->probe_cancel) == 0; entry_index++) {
+    /* warnings are non-fatal, as when the archive was read */
+    const int r = archive_read_next_header(a, &entry);
+    if (r < ARCHIVE_WARN || r == ARCHIVE_EOF) {
+      break;
+    }
+
+    cb_document_page_meta_t* meta = g_ptr_array_index(pages, i);
+    if (meta->entry != entry_index) {
+      continue;
+    }
+    i++;
+
+    int width = 0;
+    int height = 0;
+    if (probe_entry_size(a, &width, &height) == true) {
+      g_mutex_lock(&cb_document->size_lock);
+      meta->width = width;
+      meta->height = height;
+      g_mutex_unlock(&cb_document->size_lock);
+    }
+  }
+
+  /* only store complete results */
+  if (i == pages->len) {
+    cb_metadata_save(cb_document->metadata, cb_document);
+  }
+
+  archive_read_close(a);
+  archive_read_free(a);
+  g_ptr_array_free(pages, TRUE);
+
+  return NULL;
+}
+
 static int
-compare_pages(const cb_document_page_meta_t* page1, const cb_document_page_meta_t* page2)
+compare_pages(const void* data1, const void* data2)
 {
-  return compare_path(page1->file, page2->file);
+  const cb_document_page_meta_t* page1 = data1;
+  const cb_document_page_meta_t* page2 = data2;
+
+  return strcmp(page1->sort_key, page2->sort_key);
 }
 
 static char*
@@ -227,3 +816,19 @@ get_extension(const char* path)
 
   return g_ascii_strdown(res + 1, -1);
 }
+
+static void
+append_extension(girara_list_t* extensions, const char* extension)
+{
+  bool found = false;
+  GIRARA_LIST_FOREACH(extensions, char*, iter, ext)
+    if (g_strcmp0(extension, ext) == 0) {
+      found = true;
+      break;
+    }
+  GIRARA_LIST_FOREACH_END(extensions, char*, iter, ext);
+
+  if (found == false) {
+    girara_list_append(extensions, g_strdup(extension));
+  }
+}
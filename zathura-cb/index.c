@@ -17,9 +17,9 @@ cb_document_index_generate(zathura_document_t* document,
   }
 
   girara_tree_node_t* root = girara_node_new(zathura_index_element_new("ROOT"));
-  unsigned int page_number = 0;
-  GIRARA_LIST_FOREACH(cb_document->pages, cb_document_page_meta_t*, iter, page)
-  {
+  for (unsigned int page_number = 0; page_number < cb_document->pages->len; page_number++) {
+    const cb_document_page_meta_t* page = &g_array_index(cb_document->pages,
+        cb_document_page_meta_t, page_number);
     gchar* markup = g_markup_escape_text(page->file, -1);
     zathura_index_element_t* index_element = zathura_index_element_new(markup);
     g_free(markup);
@@ -33,9 +33,7 @@ cb_document_index_generate(zathura_document_t* document,
           target);
       girara_node_append_data(root, index_element);
     }
-    ++page_number;
   }
-  GIRARA_LIST_FOREACH_END(cb_document->pages, cb_document_page_meta_t*, iter, page);
 
   return root;
 }
@@ -0,0 +1,107 @@
+/* See LICENSE file for license and copyright information */
+
+#include <glib.h>
+#include <string.h>
+#include <zlib.h>
+
+#ifdef CB_WITH_LIBDEFLATE
+#include <libdeflate.h>
+#endif
+
+#include "inflate.h"
+
+static bool
+inflate_zlib(const unsigned char* src, size_t src_size, unsigned char* dst, size_t dst_size,
+    bool partial, size_t* size)
+{
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) {
+    return false;
+  }
+
+  /* zlib counts in uInt, so feed large entries in pieces */
+  int r = Z_OK;
+  size_t in = 0;
+  size_t out = 0;
+  while (r == Z_OK) {
+    stream.next_in = (Bytef*) src + in;
+    stream.avail_in = MIN(src_size - in, G_MAXUINT);
+    stream.next_out = dst + out;
+    stream.avail_out = MIN(dst_size - out, G_MAXUINT);
+    const uInt avail_in = stream.avail_in;
+    const uInt avail_out = stream.avail_out;
+
+    r = inflate(&stream, Z_NO_FLUSH);
+    in += avail_in - stream.avail_in;
+    out += avail_out - stream.avail_out;
+    if (r == Z_OK && (out == dst_size || in == src_size)) {
+      r = Z_BUF_ERROR;
+    }
+  }
+  inflateEnd(&stream);
+
+  /* a prefix may end anywhere, but a whole stream has to fill the buffer */
+  *size = out;
+  return r == Z_STREAM_END || (r == Z_BUF_ERROR && (partial == true || out == dst_size));
+}
+
+#ifdef CB_WITH_LIBDEFLATE
+static GPrivate decompressor_key = G_PRIVATE_INIT((GDestroyNotify) libdeflate_free_decompressor);
+
+static struct libdeflate_decompressor*
+get_decompressor(void)
+{
+  /* one decompressor per thread, they are not thread-safe */
+  struct libdeflate_decompressor* decompressor = g_private_get(&decompressor_key);
+  if (decompressor == NULL) {
+    decompressor = libdeflate_alloc_decompressor();
+    g_private_set(&decompressor_key, decompressor);
+  }
+
+  return decompressor;
+}
+#endif
+
+bool
+cb_inflate(const void* src, size_t src_size, void* dst, size_t dst_size, bool partial,
+    size_t* size)
+{
+  if (src == NULL || dst == NULL || size == NULL) {
+    return false;
+  }
+
+#ifdef CB_WITH_LIBDEFLATE
+  /* libdeflate only decompresses whole streams, but does so in one go
+   * straight into the buffer */
+  struct libdeflate_decompressor* decompressor = partial == false ? get_decompressor() : NULL;
+  if (decompressor != NULL) {
+    size_t out = 0;
+    const enum libdeflate_result r = libdeflate_deflate_decompress(decompressor, src, src_size,
+        dst, dst_size, &out);
+    *size = out;
+    return r == LIBDEFLATE_SUCCESS && out == dst_size;
+  }
+#endif
+
+  return inflate_zlib(src, src_size, dst, dst_size, partial, size);
+}
+
+uint32_t
+cb_crc32(uint32_t crc, const void* data, size_t size)
+{
+#ifdef CB_WITH_LIBDEFLATE
+  return libdeflate_crc32(crc, data, size);
+#else
+  /* zlib counts in uInt */
+  const unsigned char* p = data;
+  while (size > 0) {
+    const uInt length = MIN(size, G_MAXUINT);
+    crc = crc32(crc, p, length);
+    p += length;
+    size -= length;
+  }
+
+  return crc;
+#endif
+}
@@ -0,0 +1,43 @@
+/* See LICENSE file for license and copyright information */
+
+#ifndef INFLATE_H
+#define INFLATE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <girara/macros.h>
+
+/**
+ * Decompresses raw deflate data (without zlib or gzip header) into a buffer.
+ * Whole streams are decompressed in one call with libdeflate if the plugin is
+ * built with it (-Dinflate=libdeflate), otherwise with zlib.
+ *
+ * @param src Compressed data
+ * @param src_size Size of the compressed data
+ * @param dst Buffer for the decompressed data
+ * @param dst_size Size of the buffer; the exact decompressed size unless
+ *   partial is set
+ * @param partial true to decompress only as much as fits into the buffer or
+ *   can be decompressed from the given data, e.g. the start of an entry
+ * @param size Set to the number of bytes written
+ * @return true if the stream was decompressed completely into exactly
+ *   dst_size bytes, or, if partial is set, without error
+ */
+GIRARA_HIDDEN bool cb_inflate(const void* src, size_t src_size, void* dst, size_t dst_size,
+    bool partial, size_t* size);
+
+/**
+ * Updates a CRC-32 (as used by zip and gzip). libdeflate's implementation uses
+ * the carry-less multiplication and CRC instructions of the CPU where
+ * available; zlib-ng does as well when it provides zlib.
+ *
+ * @param crc CRC of the preceding data, 0 initially
+ * @param data The data
+ * @param size Size of the data
+ * @return The updated CRC
+ */
+GIRARA_HIDDEN uint32_t cb_crc32(uint32_t crc, const void* data, size_t size);
+
+#endif // INFLATE_H
@@ -3,22 +3,106 @@
 #ifndef INTERNAL_H
 #define INTERNAL_H
 
-#define LIBARCHIVE_BUFFER_SIZE 8192 
+#include <stdbool.h>
+#include <stdint.h>
+#include <glib.h>
+#include <girara/macros.h>
 
-struct cb_document_s {
-  girara_list_t* pages; /**< List of metadata structs */
-};
+#include "cache.h"
+#include "metadata.h"
+#include "prefetch.h"
+#include "source.h"
+#include "thumbnails.h"
+#include "zip.h"
 
-struct cb_page_s {
-  char* file; /**< Image associated to the page */
-};
+typedef struct cb_reader_s cb_reader_t;
+
+#define LIBARCHIVE_BUFFER_SIZE 65536
+
+/* Number of pages to read ahead and number of read-ahead threads, can be
+ * overridden with the ZATHURA_CB_PREFETCH_PAGES and
+ * ZATHURA_CB_PREFETCH_THREADS environment variables */
+#define CB_PREFETCH_PAGES_DEFAULT 3
+#define CB_PREFETCH_THREADS_DEFAULT 2
+
+/* Minimum number of pages per thread when probing the page sizes of a zip or
+ * tar archive in parallel; the number of threads can be set with the
+ * ZATHURA_CB_PROBE_THREADS environment variable */
+#define CB_PROBE_PAGES_PER_THREAD_MIN 16
+
+/* Pages are decoded at 1/2^level of their size when they are displayed
+ * smaller than that, up to this level */
+#define CB_MAX_SCALE_LEVEL 3
+
+/* Long edges of the renditions kept on disk for pages displayed at a small
+ * size, e.g. in the page overview */
+#define CB_THUMBNAIL_SMALL_SIZE 256
+#define CB_THUMBNAIL_LARGE_SIZE 1024
+
+/* Disk budget of the renditions of all archives in MiB, can be overridden
+ * with the ZATHURA_CB_THUMBNAIL_CACHE_SIZE environment variable */
+#define CB_THUMBNAIL_CACHE_SIZE_DEFAULT 256
+
+/* Memory limit of the extracted pages of a solid archive in MiB, beyond
+ * which they are moved to a temporary file; can be overridden with the
+ * ZATHURA_CB_SPOOL_MEMORY environment variable */
+#define CB_SPOOL_MEMORY_DEFAULT 256
+
+/* Memory budget of the decoded page cache in MiB, can be overridden with the
+ * ZATHURA_CB_CACHE_SIZE environment variable */
+#define CB_CACHE_SIZE_DEFAULT 256
 
 /** Image meta-data read during the document initialization
  */
 typedef struct cb_document_page_meta_s {
   char* file; /**< Image file */
-  int width; /**< Image width */
-  int height; /**< Image height */
+  char* sort_key; /**< Key to sort the pages by, see get_path_sort_key */
+  int width; /**< Image width, 0 if not known yet */
+  int height; /**< Image height, 0 if not known yet */
+  unsigned int entry; /**< Position of the entry in the archive */
+  int64_t header_offset; /**< Offset of the entry header in the archive file, -1 if unknown */
+  int64_t size; /**< Uncompressed size of the entry, -1 if unknown */
 } cb_document_page_meta_t;
 
+/* All members are set up in cb_document_open and not changed afterwards,
+ * except for the page sizes, which are protected by size_lock. The reader,
+ * cache, prefetch and thumbnails objects do their own locking, so pages may be
+ * rendered from any number of threads at the same time. */
+struct cb_document_s {
+  GArray* pages; /**< Array of cb_document_page_meta_t, sorted by path */
+  int archive_format; /**< libarchive format code of the archive */
+  int archive_filter; /**< libarchive code of the outermost filter */
+  cb_source_t* source; /**< The archive file */
+  cb_zip_t* zip; /**< Central directory of a zip archive, NULL if read through libarchive */
+  cb_reader_t* reader; /**< Pool of archive handles shared by all page reads */
+  cb_cache_t* cache; /**< Decoded pages */
+  cb_prefetch_t* prefetch; /**< Read-ahead workers, NULL if disabled */
+  cb_metadata_t* metadata; /**< On-disk cache of the page list, NULL if disabled */
+  cb_thumbnails_t* thumbnails; /**< On-disk renditions of the pages, NULL if disabled */
+  bool native_decode; /**< Decode images with the built-in decoders before gdk-pixbuf */
+  unsigned int decode_threads; /**< Threads a built-in decoder may use for one image */
+  int default_width; /**< Width of pages whose size is not known yet */
+  int default_height; /**< Height of pages whose size is not known yet */
+  GMutex size_lock; /**< Protects the sizes of the pages */
+  GThread* probe_thread; /**< Thread resolving the page sizes, NULL if not needed */
+  gint probe_cancel; /**< Set to stop the probe thread */
+};
+
+struct cb_page_s {
+  cb_document_page_meta_t* meta; /**< Meta-data of the image, owned by the document */
+};
+
+/**
+ * Returns the size of a page. If the size has not been determined yet, the
+ * default size of the document is returned.
+ *
+ * @param cb_document The document
+ * @param meta Meta-data of the page
+ * @param width Set to the width of the page
+ * @param height Set to the height of the page
+ * @return true if the real size of the page is known
+ */
+GIRARA_HIDDEN bool cb_document_get_page_size(cb_document_t* cb_document,
+    const cb_document_page_meta_t* meta, int* width, int* height);
+
 #endif // INTERNAL_H
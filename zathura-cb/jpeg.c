@@ -0,0 +1,94 @@
+/* See LICENSE file for license and copyright information */
+
+#include <glib.h>
+#include <limits.h>
+#include <turbojpeg.h>
+
+#include "jpeg.h"
+
+static void
+destroy_decompressor(gpointer handle)
+{
+  tjDestroy(handle);
+}
+
+static GPrivate decompressor_key = G_PRIVATE_INIT(destroy_decompressor);
+
+static tjhandle
+get_decompressor(void)
+{
+  /* one decompressor per thread, they are not thread-safe */
+  tjhandle handle = g_private_get(&decompressor_key);
+  if (handle == NULL) {
+    handle = tjInitDecompress();
+    g_private_set(&decompressor_key, handle);
+  }
+
+  return handle;
+}
+
+static tjscalingfactor
+get_scaling_factor(unsigned int level)
+{
+  int count = 0;
+  const tjscalingfactor* factors = tjGetScalingFactors(&count);
+
+  /* pick the largest supported reduction up to the requested one; all
+   * versions support 1/2, 1/4 and 1/8 */
+  for (; level > 0; level--) {
+    for (int i = 0; factors != NULL && i < count; i++) {
+      if (factors[i].num == 1 && factors[i].denom == (1 << level)) {
+        return factors[i];
+      }
+    }
+  }
+
+  return (tjscalingfactor) { 1, 1 };
+}
+
+cairo_surface_t*
+cb_jpeg_decode(const void* data, size_t size, unsigned int level)
+{
+  tjhandle handle = get_decompressor();
+  if (data == NULL || handle == NULL || size > ULONG_MAX) {
+    return NULL;
+  }
+
+  int width = 0;
+  int height = 0;
+  int subsampling = 0;
+  int colorspace = 0;
+  if (tjDecompressHeader3(handle, (unsigned char*) data, size, &width, &height, &subsampling, &colorspace) != 0) {
+    return NULL;
+  }
+
+  /* TurboJPEG cannot convert CMYK to RGB */
+  if (colorspace == TJCS_CMYK || colorspace == TJCS_YCCK) {
+    return NULL;
+  }
+
+  const tjscalingfactor factor = get_scaling_factor(level);
+  width = TJSCALED(width, factor);
+  height = TJSCALED(height, factor);
+
+  cairo_surface_t* surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, width, height);
+  if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS) {
+    cairo_surface_destroy(surface);
+    return NULL;
+  }
+
+  /* cairo stores pixels as native-endian 32-bit words, 0xXXRRGGBB */
+  const int format = G_BYTE_ORDER == G_LITTLE_ENDIAN ? TJPF_BGRX : TJPF_XRGB;
+
+  cairo_surface_flush(surface);
+  const int r = tjDecompress2(handle, (unsigned char*) data, size, cairo_image_surface_get_data(surface), width,
+      cairo_image_surface_get_stride(surface), height, format, 0);
+  /* like gdk-pixbuf, show what could be decoded of truncated images */
+  if (r != 0 && tjGetErrorCode(handle) != TJERR_WARNING) {
+    cairo_surface_destroy(surface);
+    return NULL;
+  }
+  cairo_surface_mark_dirty(surface);
+
+  return surface;
+}
@@ -0,0 +1,24 @@
+/* See LICENSE file for license and copyright information */
+
+#ifndef JPEG_H
+#define JPEG_H
+
+#include <stddef.h>
+#include <cairo.h>
+
+#include <girara/macros.h>
+
+/**
+ * Decodes a JPEG image with the TurboJPEG API of libjpeg-turbo directly into
+ * the pixel layout of a cairo surface. Reductions are done by the inverse DCT,
+ * which produces the image at 1/2, 1/4 or 1/8 of its size at a fraction of the
+ * cost of decoding it completely. CMYK images are left to gdk-pixbuf.
+ *
+ * @param data The JPEG data
+ * @param size Size of the data
+ * @param level Scale level, the image is decoded at 1/2^level of its size
+ * @return A CAIRO_FORMAT_RGB24 image surface or NULL if an error occurred
+ */
+GIRARA_HIDDEN cairo_surface_t* cb_jpeg_decode(const void* data, size_t size, unsigned int level);
+
+#endif // JPEG_H
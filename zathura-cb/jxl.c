@@ -0,0 +1,149 @@
+/* See LICENSE file for license and copyright information */
+
+#include <glib.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <string.h>
+#include <jxl/decode.h>
+#include <jxl/thread_parallel_runner.h>
+
+#include "convert.h"
+#include "jxl.h"
+
+/** Destination of the pixels written by the decoder threads
+ */
+typedef struct jxl_output_s {
+  unsigned char* pixels; /**< Pixels of the surface */
+  size_t stride; /**< Stride of the surface */
+  bool premultiplied; /**< Whether the image stores premultiplied alpha */
+} jxl_output_t;
+
+/** Thread pool of a rendering thread
+ */
+typedef struct jxl_runner_s {
+  void* runner; /**< The thread pool */
+  unsigned int threads; /**< Number of threads of the pool */
+} jxl_runner_t;
+
+static void
+runner_free(jxl_runner_t* runner)
+{
+  JxlThreadParallelRunnerDestroy(runner->runner);
+  g_free(runner);
+}
+
+static GPrivate runner_key = G_PRIVATE_INIT((GDestroyNotify) runner_free);
+
+static void*
+get_runner(unsigned int threads)
+{
+  /* one thread pool per rendering thread, so that a page decoded by the
+   * read-ahead does not wait for the one being displayed; the callers size
+   * the pools so that all of them together do not exceed the processors */
+  jxl_runner_t* runner = g_private_get(&runner_key);
+  if (runner == NULL || runner->threads != threads) {
+    void* pool = JxlThreadParallelRunnerCreate(NULL, threads);
+    if (pool == NULL) {
+      return NULL;
+    }
+
+    runner = g_malloc(sizeof(jxl_runner_t));
+    runner->runner = pool;
+    runner->threads = threads;
+    g_private_replace(&runner_key, runner);
+  }
+
+  return runner->runner;
+}
+
+static void
+write_pixels(void* data, size_t x, size_t y, size_t num_pixels, const void* pixels)
+{
+  /* called for parts of rows, from several threads at once */
+  const jxl_output_t* output = data;
+  uint32_t* row = (uint32_t*) (output->pixels + y * output->stride) + x;
+  if (output->premultiplied == false) {
+    cb_convert_rgba_to_argb(pixels, row, num_pixels);
+    return;
+  }
+
+  /* premultiplied images only need their channels reordered */
+  const uint8_t* src = pixels;
+  for (size_t i = 0; i < num_pixels; i++, src += 4) {
+    row[i] = (uint32_t) src[3] << 24 | (uint32_t) src[0] << 16 | (uint32_t) src[1] << 8 | src[2];
+  }
+}
+
+cairo_surface_t*
+cb_jxl_decode(const void* data, size_t size, unsigned int threads)
+{
+  if (data == NULL) {
+    return NULL;
+  }
+
+  JxlDecoder* decoder = JxlDecoderCreate(NULL);
+  void* runner = get_runner(MAX(threads, 1));
+  cairo_surface_t* surface = NULL;
+  if (decoder == NULL || runner == NULL
+      || JxlDecoderSetParallelRunner(decoder, JxlThreadParallelRunner, runner) != JXL_DEC_SUCCESS
+      || JxlDecoderSubscribeEvents(decoder,
+        JXL_DEC_BASIC_INFO | JXL_DEC_COLOR_ENCODING | JXL_DEC_FULL_IMAGE) != JXL_DEC_SUCCESS
+      || JxlDecoderSetInput(decoder, data, size) != JXL_DEC_SUCCESS) {
+    goto error_free;
+  }
+  JxlDecoderCloseInput(decoder);
+
+  const JxlPixelFormat format = { 4, JXL_TYPE_UINT8, JXL_NATIVE_ENDIAN, 0 };
+  JxlBasicInfo info;
+  memset(&info, 0, sizeof(info));
+  jxl_output_t output = { NULL, 0, false };
+  while (true) {
+    const JxlDecoderStatus status = JxlDecoderProcessInput(decoder);
+    if (status == JXL_DEC_BASIC_INFO) {
+      if (JxlDecoderGetBasicInfo(decoder, &info) != JXL_DEC_SUCCESS
+          || info.xsize > INT_MAX || info.ysize > INT_MAX) {
+        goto error_free;
+      }
+
+      surface = cairo_image_surface_create(
+          info.alpha_bits > 0 ? CAIRO_FORMAT_ARGB32 : CAIRO_FORMAT_RGB24, info.xsize, info.ysize);
+      if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS) {
+        goto error_free;
+      }
+      cairo_surface_flush(surface);
+      output.pixels = cairo_image_surface_get_data(surface);
+      output.stride = cairo_image_surface_get_stride(surface);
+      output.premultiplied = info.alpha_bits > 0 && info.alpha_premultiplied == JXL_TRUE;
+    } else if (status == JXL_DEC_COLOR_ENCODING) {
+      /* images stored in XYB can be converted to any color space; this fails
+       * harmlessly for all others, which keep their own */
+      JxlColorEncoding srgb;
+      JxlColorEncodingSetToSRGB(&srgb, info.num_color_channels == 1 ? JXL_TRUE : JXL_FALSE);
+      JxlDecoderSetPreferredColorProfile(decoder, &srgb);
+    } else if (status == JXL_DEC_NEED_IMAGE_OUT_BUFFER) {
+      if (surface == NULL
+          || JxlDecoderSetImageOutCallback(decoder, &format, write_pixels, &output) != JXL_DEC_SUCCESS) {
+        goto error_free;
+      }
+    } else if (status == JXL_DEC_FULL_IMAGE) {
+      /* only the first frame of an animation is shown */
+      break;
+    } else {
+      goto error_free;
+    }
+  }
+
+  cairo_surface_mark_dirty(surface);
+  JxlDecoderDestroy(decoder);
+
+  return surface;
+
+error_free:
+
+  cairo_surface_destroy(surface);
+  if (decoder != NULL) {
+    JxlDecoderDestroy(decoder);
+  }
+
+  return NULL;
+}
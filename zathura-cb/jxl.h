@@ -0,0 +1,25 @@
+/* See LICENSE file for license and copyright information */
+
+#ifndef JXL_H
+#define JXL_H
+
+#include <stddef.h>
+#include <cairo.h>
+
+#include <girara/macros.h>
+
+/**
+ * Decodes a JPEG XL image (bare codestream or container) with libjxl. Groups
+ * of the image are decoded by a thread pool of libjxl, one per calling
+ * thread, and converted to cairo's pixel format by the thread that decoded them. Only the
+ * first frame of animations is decoded.
+ *
+ * @param data The JPEG XL data
+ * @param size Size of the data
+ * @param threads Number of threads of the pool
+ * @return A CAIRO_FORMAT_ARGB32 surface for images with alpha, a
+ *   CAIRO_FORMAT_RGB24 surface otherwise, or NULL if an error occurred
+ */
+GIRARA_HIDDEN cairo_surface_t* cb_jxl_decode(const void* data, size_t size, unsigned int threads);
+
+#endif // JXL_H
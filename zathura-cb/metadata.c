@@ -0,0 +1,220 @@
+/* See LICENSE file for license and copyright information */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <girara/datastructures.h>
+#include <girara/log.h>
+
+#include "metadata.h"
+#include "internal.h"
+
+/* Bumped whenever the layout of a cache entry or the meaning of its fields
+ * changes; entries of other versions are ignored */
+#define CB_METADATA_VERSION 1
+
+/* Number of bytes at the end of the archive that are checksummed */
+#define CB_METADATA_TAIL_SIZE 65536
+
+/* version, path, size, mtime, tail checksum, extensions checksum, format,
+ * filter, default width, default height, pages */
+#define CB_METADATA_TYPE "(uayxxssiiiia(ayiiuxx))"
+
+struct cb_metadata_s {
+  char* path; /**< Path of the archive */
+  char* file; /**< Path of the cache entry */
+  int64_t size; /**< Size of the archive */
+  int64_t mtime; /**< Modification time of the archive */
+  char* tail_checksum; /**< Checksum of the end of the archive */
+  char* extensions_checksum; /**< Checksum of the supported extensions */
+  char* fingerprint; /**< Identifies the contents of the archive */
+};
+
+static char*
+get_tail_checksum(cb_source_t* source)
+{
+  const int64_t size = cb_source_get_size(source);
+  const size_t length = MIN(size, CB_METADATA_TAIL_SIZE);
+
+  unsigned char* buffer = g_malloc(MAX(length, 1));
+  char* checksum = NULL;
+  if (cb_source_read(source, buffer, length, size - length) == true) {
+    checksum = g_compute_checksum_for_data(G_CHECKSUM_SHA256, buffer, length);
+  }
+  g_free(buffer);
+
+  return checksum;
+}
+
+static char*
+get_extensions_checksum(girara_list_t* supported_extensions)
+{
+  GChecksum* checksum = g_checksum_new(G_CHECKSUM_SHA256);
+  GIRARA_LIST_FOREACH(supported_extensions, char*, iter, ext)
+    g_checksum_update(checksum, (const guchar*) ext, -1);
+    g_checksum_update(checksum, (const guchar*) "\n", 1);
+  GIRARA_LIST_FOREACH_END(supported_extensions, char*, iter, ext);
+
+  char* result = g_strdup(g_checksum_get_string(checksum));
+  g_checksum_free(checksum);
+
+  return result;
+}
+
+cb_metadata_t*
+cb_metadata_new(const char* path, cb_source_t* source, girara_list_t* supported_extensions)
+{
+  if (path == NULL || source == NULL || supported_extensions == NULL) {
+    return NULL;
+  }
+
+  char* tail_checksum = get_tail_checksum(source);
+  if (tail_checksum == NULL) {
+    return NULL;
+  }
+
+  cb_metadata_t* metadata = g_malloc0(sizeof(cb_metadata_t));
+  metadata->path = g_strdup(path);
+  metadata->size = cb_source_get_size(source);
+  metadata->mtime = cb_source_get_mtime(source);
+  metadata->tail_checksum = tail_checksum;
+  metadata->extensions_checksum = get_extensions_checksum(supported_extensions);
+
+  char* identity = g_strdup_printf("%s\n%" G_GINT64_FORMAT "\n%" G_GINT64_FORMAT "\n%s",
+      path, (gint64) metadata->size, (gint64) metadata->mtime, tail_checksum);
+  metadata->fingerprint = g_compute_checksum_for_string(G_CHECKSUM_SHA256, identity, -1);
+  g_free(identity);
+
+  /* one entry per path, so that a changed archive replaces its old entry */
+  char* name = g_compute_checksum_for_string(G_CHECKSUM_SHA256, path, -1);
+  char* basename = g_strdup_printf("%s.meta", name);
+  metadata->file = g_build_filename(g_get_user_cache_dir(), "zathura-cb", basename, NULL);
+  g_free(basename);
+  g_free(name);
+
+  return metadata;
+}
+
+void
+cb_metadata_free(cb_metadata_t* metadata)
+{
+  if (metadata == NULL) {
+    return;
+  }
+
+  g_free(metadata->path);
+  g_free(metadata->file);
+  g_free(metadata->tail_checksum);
+  g_free(metadata->extensions_checksum);
+  g_free(metadata->fingerprint);
+  g_free(metadata);
+}
+
+const char*
+cb_metadata_get_fingerprint(cb_metadata_t* metadata)
+{
+  return metadata != NULL ? metadata->fingerprint : NULL;
+}
+
+bool
+cb_metadata_load(cb_metadata_t* metadata, cb_document_t* cb_document)
+{
+  if (metadata == NULL || cb_document == NULL) {
+    return false;
+  }
+
+  char* contents = NULL;
+  gsize length = 0;
+  if (g_file_get_contents(metadata->file, &contents, &length, NULL) == FALSE) {
+    return false;
+  }
+
+  /* the entry is untrusted, but GVariant copes with any serialized data */
+  GVariant* variant = g_variant_new_from_data(G_VARIANT_TYPE(CB_METADATA_TYPE), contents,
+      length, FALSE, g_free, contents);
+  g_variant_ref_sink(variant);
+
+  guint32 version = 0;
+  char* path = NULL;
+  gint64 size = 0;
+  gint64 mtime = 0;
+  const char* tail_checksum = NULL;
+  const char* extensions_checksum = NULL;
+  gint32 format = 0;
+  gint32 filter = 0;
+  gint32 default_width = 0;
+  gint32 default_height = 0;
+  GVariantIter* pages = NULL;
+  g_variant_get(variant, "(u^ayxx&s&siiiia(ayiiuxx))", &version, &path, &size, &mtime,
+      &tail_checksum, &extensions_checksum, &format, &filter, &default_width,
+      &default_height, &pages);
+
+  bool valid = version == CB_METADATA_VERSION
+    && g_strcmp0(path, metadata->path) == 0
+    && size == metadata->size
+    && mtime == metadata->mtime
+    && g_strcmp0(tail_checksum, metadata->tail_checksum) == 0
+    && g_strcmp0(extensions_checksum, metadata->extensions_checksum) == 0;
+
+  if (valid == true) {
+    char* file = NULL;
+    cb_document_page_meta_t meta = { .sort_key = NULL };
+    while (g_variant_iter_next(pages, "(^ayiiuxx)", &file, &meta.width, &meta.height,
+          &meta.entry, &meta.header_offset, &meta.size) == TRUE) {
+      meta.file = file;
+      meta.width = MAX(meta.width, 0);
+      meta.height = MAX(meta.height, 0);
+      g_array_append_val(cb_document->pages, meta);
+    }
+
+    cb_document->archive_format = format;
+    cb_document->archive_filter = filter;
+    cb_document->default_width = default_width;
+    cb_document->default_height = default_height;
+  }
+
+  g_variant_iter_free(pages);
+  g_free(path);
+  g_variant_unref(variant);
+
+  if (valid == true) {
+    girara_debug("read page list of %s from %s", metadata->path, metadata->file);
+  }
+
+  return valid;
+}
+
+bool
+cb_metadata_save(cb_metadata_t* metadata, cb_document_t* cb_document)
+{
+  if (metadata == NULL || cb_document == NULL) {
+    return false;
+  }
+
+  GVariantBuilder pages;
+  g_variant_builder_init(&pages, G_VARIANT_TYPE("a(ayiiuxx)"));
+  for (guint i = 0; i < cb_document->pages->len; i++) {
+    const cb_document_page_meta_t* meta = &g_array_index(cb_document->pages, cb_document_page_meta_t, i);
+    g_variant_builder_add(&pages, "(^ayiiuxx)", meta->file, meta->width, meta->height,
+        meta->entry, (gint64) meta->header_offset, (gint64) meta->size);
+  }
+
+  GVariant* variant = g_variant_new("(u^ayxxssiiiia(ayiiuxx))", (guint32) CB_METADATA_VERSION,
+      metadata->path, (gint64) metadata->size, (gint64) metadata->mtime,
+      metadata->tail_checksum, metadata->extensions_checksum,
+      (gint32) cb_document->archive_format, (gint32) cb_document->archive_filter,
+      (gint32) cb_document->default_width, (gint32) cb_document->default_height, &pages);
+  g_variant_ref_sink(variant);
+
+  bool saved = false;
+  char* directory = g_path_get_dirname(metadata->file);
+  if (g_mkdir_with_parents(directory, 0700) == 0) {
+    /* written to a temporary file and renamed, so readers never see a
+     * partial entry */
+    saved = g_file_set_contents(metadata->file, g_variant_get_data(variant),
+        g_variant_get_size(variant), NULL) == TRUE;
+  }
+  g_free(directory);
+  g_variant_unref(variant);
+
+  return saved;
+}
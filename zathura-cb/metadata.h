@@ -0,0 +1,68 @@
+/* See LICENSE file for license and copyright information */
+
+#ifndef METADATA_H
+#define METADATA_H
+
+#include <stdbool.h>
+
+#include <girara/macros.h>
+#include <girara/types.h>
+
+#include "plugin.h"
+#include "source.h"
+
+typedef struct cb_metadata_s cb_metadata_t;
+
+/**
+ * Prepares the on-disk cache of the page list of an archive. Entries live in
+ * $XDG_CACHE_HOME/zathura-cb/ and are only used while the path, size and
+ * modification time of the archive, a checksum of its last bytes (where the
+ * central directory of zip and 7z archives is stored) and the set of
+ * supported image extensions are unchanged.
+ *
+ * @param path Path of the archive
+ * @param source The opened archive
+ * @param supported_extensions List of image extensions that are pages
+ * @return The cache entry or NULL if an error occurred
+ */
+GIRARA_HIDDEN cb_metadata_t* cb_metadata_new(const char* path, cb_source_t* source,
+    girara_list_t* supported_extensions);
+
+/**
+ * Frees the cache entry
+ *
+ * @param metadata The cache entry
+ */
+GIRARA_HIDDEN void cb_metadata_free(cb_metadata_t* metadata);
+
+/**
+ * Returns a fingerprint of the archive built from its path, size,
+ * modification time and the checksum of its last bytes
+ *
+ * @param metadata The cache entry
+ * @return The fingerprint, owned by the cache entry
+ */
+GIRARA_HIDDEN const char* cb_metadata_get_fingerprint(cb_metadata_t* metadata);
+
+/**
+ * Fills the page list, page sizes and archive format of a document from the
+ * cache
+ *
+ * @param metadata The cache entry
+ * @param cb_document The document, with an empty page array
+ * @return true if a valid entry was found
+ */
+GIRARA_HIDDEN bool cb_metadata_load(cb_metadata_t* metadata, cb_document_t* cb_document);
+
+/**
+ * Stores the page list, page sizes and archive format of a document in the
+ * cache. The pages must be sorted and their sizes must not change while the
+ * entry is written.
+ *
+ * @param metadata The cache entry
+ * @param cb_document The document
+ * @return true if the entry was written
+ */
+GIRARA_HIDDEN bool cb_metadata_save(cb_metadata_t* metadata, cb_document_t* cb_document);
+
+#endif // METADATA_H
@@ -20,19 +20,25 @@ cb_page_init(zathura_page_t* page)
     return ZATHURA_ERROR_UNKNOWN;
   }
 
-  cb_document_page_meta_t* meta = girara_list_nth(cb_document->pages, zathura_page_get_index(page));
-  if (meta == NULL || meta->file == NULL) {
+  const unsigned int index = zathura_page_get_index(page);
+  if (index >= cb_document->pages->len) {
     return ZATHURA_ERROR_UNKNOWN;
   }
 
+  cb_document_page_meta_t* meta = &g_array_index(cb_document->pages, cb_document_page_meta_t, index);
+
   cb_page_t* cb_page = g_malloc0(sizeof(cb_page_t));
   if (cb_page == NULL) {
     return ZATHURA_ERROR_OUT_OF_MEMORY;
   }
 
-  cb_page->file = g_strdup(meta->file);
-  zathura_page_set_width(page, meta->width);
-  zathura_page_set_height(page, meta->height);
+  int width = 0;
+  int height = 0;
+  cb_document_get_page_size(cb_document, meta, &width, &height);
+
+  cb_page->meta = meta;
+  zathura_page_set_width(page, width);
+  zathura_page_set_height(page, height);
   zathura_page_set_data(page, cb_page);
 
   return ZATHURA_ERROR_OK;
@@ -46,7 +52,6 @@ cb_page_clear(zathura_page_t* UNUSED(page), void* data)
     return ZATHURA_ERROR_OK;
   }
 
-  g_free(cb_page->file);
   g_free(cb_page);
 
   return ZATHURA_ERROR_OK;
@@ -60,7 +60,8 @@ zathura_error_t cb_page_init(zathura_page_t* page);
 GIRARA_HIDDEN zathura_error_t cb_page_clear(zathura_page_t* page, void* cb_page);
 
 /**
- * Renders the page to a cairo object
+ * Renders the page to a cairo object. Pages of the same document may be
+ * rendered from several threads at the same time.
  *
  * @param page The page
  * @param cb_page cb Page
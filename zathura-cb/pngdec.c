@@ -0,0 +1,164 @@
+/* See LICENSE file for license and copyright information */
+
+#include <glib.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <string.h>
+
+#ifdef CB_WITH_SPNG
+#include <spng.h>
+#else
+#include <png.h>
+#endif
+
+#include "convert.h"
+#include "pngdec.h"
+
+static cairo_surface_t*
+create_surface(unsigned int width, unsigned int height, bool has_alpha)
+{
+  if (width > INT_MAX || height > INT_MAX) {
+    return NULL;
+  }
+
+  cairo_surface_t* surface = cairo_image_surface_create(
+      has_alpha == true ? CAIRO_FORMAT_ARGB32 : CAIRO_FORMAT_RGB24, width, height);
+  if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS) {
+    cairo_surface_destroy(surface);
+    return NULL;
+  }
+
+  cairo_surface_flush(surface);
+  return surface;
+}
+
+static void
+convert_row(cairo_surface_t* surface, unsigned int y)
+{
+  /* the RGBA pixels are replaced by their cairo counterparts of the same size */
+  unsigned char* row = cairo_image_surface_get_data(surface)
+    + (size_t) y * cairo_image_surface_get_stride(surface);
+  cb_convert_rgba_to_argb(row, (uint32_t*) row, cairo_image_surface_get_width(surface));
+}
+
+#ifdef CB_WITH_SPNG
+cairo_surface_t*
+cb_png_decode(const void* data, size_t size, bool verified)
+{
+  /* data that has been verified as a whole, e.g. a zip entry checked against
+   * its CRC-32, does not need the checksums of the chunks and of the
+   * compressed stream to be computed again */
+  spng_ctx* ctx = spng_ctx_new(verified == true ? SPNG_CTX_IGNORE_ADLER32 : 0);
+  if (data == NULL || ctx == NULL) {
+    spng_ctx_free(ctx);
+    return NULL;
+  }
+  if (verified == true) {
+    spng_set_crc_action(ctx, SPNG_CRC_USE, SPNG_CRC_USE);
+  }
+
+  cairo_surface_t* surface = NULL;
+  struct spng_ihdr ihdr;
+  struct spng_trns trns;
+  if (spng_set_png_buffer(ctx, data, size) != 0 || spng_get_ihdr(ctx, &ihdr) != 0) {
+    goto error_free;
+  }
+
+  const bool has_alpha = ihdr.color_type == SPNG_COLOR_TYPE_GRAYSCALE_ALPHA
+    || ihdr.color_type == SPNG_COLOR_TYPE_TRUECOLOR_ALPHA || spng_get_trns(ctx, &trns) == 0;
+  surface = create_surface(ihdr.width, ihdr.height, has_alpha);
+  if (surface == NULL
+      || spng_decode_image(ctx, NULL, 0, SPNG_FMT_RGBA8,
+        SPNG_DECODE_TRNS | SPNG_DECODE_PROGRESSIVE) != 0) {
+    goto error_free;
+  }
+
+  /* rows are converted while they are still in the cache; the passes of
+   * interlaced images each fill in only some pixels of a row, so those are
+   * converted at the end */
+  unsigned char* pixels = cairo_image_surface_get_data(surface);
+  const size_t stride = cairo_image_surface_get_stride(surface);
+  const bool interlaced = ihdr.interlace_method != SPNG_INTERLACE_NONE;
+  struct spng_row_info info;
+  int r = 0;
+  do {
+    r = spng_get_row_info(ctx, &info);
+    if (r == 0) {
+      r = spng_decode_row(ctx, pixels + info.row_num * stride, (size_t) ihdr.width * 4);
+      if ((r == 0 || r == SPNG_EOI) && interlaced == false) {
+        convert_row(surface, info.row_num);
+      }
+    }
+  } while (r == 0);
+  if (r != SPNG_EOI) {
+    goto error_free;
+  }
+
+  if (interlaced == true) {
+    for (unsigned int y = 0; y < ihdr.height; y++) {
+      convert_row(surface, y);
+    }
+  }
+  cairo_surface_mark_dirty(surface);
+  spng_ctx_free(ctx);
+
+  return surface;
+
+error_free:
+
+  cairo_surface_destroy(surface);
+  spng_ctx_free(ctx);
+
+  return NULL;
+}
+#else
+cairo_surface_t*
+cb_png_decode(const void* data, size_t size, bool UNUSED(verified))
+{
+  /* the simplified API always checks the checksums */
+  if (data == NULL) {
+    return NULL;
+  }
+
+  png_image image;
+  memset(&image, 0, sizeof(image));
+  image.version = PNG_IMAGE_VERSION;
+  if (png_image_begin_read_from_memory(&image, data, size) == 0) {
+    return NULL;
+  }
+
+  /* take 16 bit images without gamma information as sRGB like gdk-pixbuf,
+   * instead of as linear */
+  image.flags |= PNG_IMAGE_FLAG_16BIT_sRGB;
+
+  const bool has_alpha = (image.format & PNG_FORMAT_FLAG_ALPHA) != 0;
+  cairo_surface_t* surface = create_surface(image.width, image.height, has_alpha);
+  if (surface == NULL) {
+    png_image_free(&image);
+    return NULL;
+  }
+
+  /* opaque images are written in cairo's layout right away, transparent ones
+   * still need to be premultiplied */
+  if (has_alpha == true) {
+    image.format = PNG_FORMAT_RGBA;
+  } else {
+    image.format = G_BYTE_ORDER == G_LITTLE_ENDIAN ? PNG_FORMAT_BGRA : PNG_FORMAT_ARGB;
+  }
+
+  if (png_image_finish_read(&image, NULL, cairo_image_surface_get_data(surface),
+        cairo_image_surface_get_stride(surface), NULL) == 0) {
+    cairo_surface_destroy(surface);
+    return NULL;
+  }
+
+  if (has_alpha == true) {
+    for (unsigned int y = 0; y < image.height; y++) {
+      convert_row(surface, y);
+    }
+  }
+  cairo_surface_mark_dirty(surface);
+
+  return surface;
+}
+#endif
@@ -0,0 +1,28 @@
+/* See LICENSE file for license and copyright information */
+
+#ifndef PNGDEC_H
+#define PNGDEC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <cairo.h>
+
+#include <girara/macros.h>
+
+/**
+ * Decodes a PNG image straight into the rows of a cairo surface, with libspng
+ * or, if the plugin is built without it, the simplified API of libpng.
+ * Palette, gray, 16 bit and transparent images are expanded to 8 bit RGBA by
+ * the library and premultiplied in place. Ancillary chunks other than tRNS
+ * are not interpreted.
+ *
+ * @param data The PNG data
+ * @param size Size of the data
+ * @param verified Whether the data has already been checked against a
+ *   checksum, in which case libspng skips the checksums of the PNG stream
+ * @return A CAIRO_FORMAT_ARGB32 surface for images with transparency, a
+ *   CAIRO_FORMAT_RGB24 surface otherwise, or NULL if an error occurred
+ */
+GIRARA_HIDDEN cairo_surface_t* cb_png_decode(const void* data, size_t size, bool verified);
+
+#endif // PNGDEC_H
@@ -0,0 +1,142 @@
+/* See LICENSE file for license and copyright information */
+
+#include <glib.h>
+
+#include "prefetch.h"
+#include "internal.h"
+#include "render.h"
+
+struct cb_prefetch_s {
+  cb_document_t* document; /**< The document */
+  GThreadPool* pool; /**< Workers, fed with page index + 1 */
+  unsigned int number_of_pages; /**< Number of pages */
+  unsigned int pages; /**< Size of the read-ahead window */
+  gint current; /**< Page the window is centered on, accessed atomically */
+  gint level; /**< Scale level to decode pages at, accessed atomically */
+  GMutex lock; /**< Protects pending */
+  GHashTable* pending; /**< Pages that are queued or being decoded */
+};
+
+static bool
+in_window(cb_prefetch_t* prefetch, unsigned int index)
+{
+  const unsigned int current = g_atomic_int_get(&prefetch->current);
+  return index + 1 >= current && index <= current + prefetch->pages;
+}
+
+static gint
+compare_distance(gconstpointer a, gconstpointer b, gpointer data)
+{
+  cb_prefetch_t* prefetch = data;
+  const gint current = g_atomic_int_get(&prefetch->current);
+
+  /* pages ahead of the current page come first, then the one behind it */
+  gint da = (gint) GPOINTER_TO_UINT(a) - 1 - current;
+  gint db = (gint) GPOINTER_TO_UINT(b) - 1 - current;
+  da = da < 0 ? -da * 2 : da * 2 - 1;
+  db = db < 0 ? -db * 2 : db * 2 - 1;
+
+  return da - db;
+}
+
+static void
+prefetch_page(gpointer data, gpointer user_data)
+{
+  cb_prefetch_t* prefetch = user_data;
+  const unsigned int index = GPOINTER_TO_UINT(data) - 1;
+  cb_document_t* cb_document = prefetch->document;
+
+  /* skip pages the reader has moved away from in the meantime */
+  const unsigned int level = g_atomic_int_get(&prefetch->level);
+  if (in_window(prefetch, index) == true
+      && cb_cache_contains(cb_document->cache, index, level) == false) {
+    cb_document_page_meta_t* meta = &g_array_index(cb_document->pages, cb_document_page_meta_t, index);
+    cairo_surface_t* surface = cb_page_load_surface(cb_document, meta, level);
+    if (surface != NULL) {
+      cb_cache_insert(cb_document->cache, index, level, surface);
+      cairo_surface_destroy(surface);
+    }
+  }
+
+  g_mutex_lock(&prefetch->lock);
+  g_hash_table_remove(prefetch->pending, data);
+  g_mutex_unlock(&prefetch->lock);
+}
+
+cb_prefetch_t*
+cb_prefetch_new(cb_document_t* cb_document, unsigned int number_of_pages,
+    unsigned int pages, unsigned int threads)
+{
+  if (cb_document == NULL || pages == 0 || threads == 0) {
+    return NULL;
+  }
+
+  cb_prefetch_t* prefetch = g_malloc0(sizeof(cb_prefetch_t));
+  prefetch->document = cb_document;
+  prefetch->number_of_pages = number_of_pages;
+  prefetch->pages = pages;
+  g_mutex_init(&prefetch->lock);
+  prefetch->pending = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+  prefetch->pool = g_thread_pool_new(prefetch_page, prefetch, threads, FALSE, NULL);
+  if (prefetch->pool == NULL) {
+    g_hash_table_destroy(prefetch->pending);
+    g_mutex_clear(&prefetch->lock);
+    g_free(prefetch);
+    return NULL;
+  }
+  g_thread_pool_set_sort_function(prefetch->pool, compare_distance, prefetch);
+
+  return prefetch;
+}
+
+void
+cb_prefetch_free(cb_prefetch_t* prefetch)
+{
+  if (prefetch == NULL) {
+    return;
+  }
+
+  /* queued items are plain integers, so nothing leaks when they are dropped */
+  g_thread_pool_free(prefetch->pool, TRUE, TRUE);
+  g_hash_table_destroy(prefetch->pending);
+  g_mutex_clear(&prefetch->lock);
+  g_free(prefetch);
+}
+
+static void
+prefetch_queue(cb_prefetch_t* prefetch, unsigned int index, unsigned int level)
+{
+  if (index >= prefetch->number_of_pages
+      || cb_cache_contains(prefetch->document->cache, index, level) == true) {
+    return;
+  }
+
+  gpointer item = GUINT_TO_POINTER(index + 1);
+
+  g_mutex_lock(&prefetch->lock);
+  if (g_hash_table_contains(prefetch->pending, item) == FALSE) {
+    g_hash_table_insert(prefetch->pending, item, item);
+    g_thread_pool_push(prefetch->pool, item, NULL);
+  }
+  g_mutex_unlock(&prefetch->lock);
+}
+
+void
+cb_prefetch_schedule(cb_prefetch_t* prefetch, unsigned int index, unsigned int level)
+{
+  if (prefetch == NULL) {
+    return;
+  }
+
+  g_atomic_int_set(&prefetch->level, level);
+  g_atomic_int_set(&prefetch->current, index);
+
+  for (unsigned int i = 1; i <= prefetch->pages; i++) {
+    prefetch_queue(prefetch, index + i, level);
+  }
+
+  if (index > 0) {
+    prefetch_queue(prefetch, index - 1, level);
+  }
+}
@@ -0,0 +1,45 @@
+/* See LICENSE file for license and copyright information */
+
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include <girara/macros.h>
+
+#include "plugin.h"
+
+typedef struct cb_prefetch_s cb_prefetch_t;
+
+/**
+ * Creates the read-ahead workers of a document. Decoded pages are stored in
+ * the page cache of the document.
+ *
+ * @param cb_document The document
+ * @param number_of_pages Number of pages of the document
+ * @param pages Number of pages to read ahead of the current page
+ * @param threads Number of worker threads
+ * @return The prefetcher or NULL if read-ahead is disabled or the worker pool
+ *   could not be created
+ */
+GIRARA_HIDDEN cb_prefetch_t* cb_prefetch_new(cb_document_t* cb_document,
+    unsigned int number_of_pages, unsigned int pages, unsigned int threads);
+
+/**
+ * Stops the workers, dropping all queued pages and waiting for the pages that
+ * are currently decoded
+ *
+ * @param prefetch The prefetcher
+ */
+GIRARA_HIDDEN void cb_prefetch_free(cb_prefetch_t* prefetch);
+
+/**
+ * Moves the read-ahead window to a page and queues the pages around it that
+ * are not cached yet. Queued pages that fall out of the window are skipped.
+ *
+ * @param prefetch The prefetcher
+ * @param index Index of the page that is currently rendered
+ * @param level Scale level the page is rendered at
+ */
+GIRARA_HIDDEN void cb_prefetch_schedule(cb_prefetch_t* prefetch, unsigned int index,
+    unsigned int level);
+
+#endif // PREFETCH_H
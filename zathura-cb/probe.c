@@ -0,0 +1,520 @@
+/* See LICENSE file for license and copyright information */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "probe.h"
+
+static uint32_t
+read_be16(const unsigned char* data)
+{
+  return ((uint32_t) data[0] << 8) | data[1];
+}
+
+static uint32_t
+read_be32(const unsigned char* data)
+{
+  return ((uint32_t) data[0] << 24) | ((uint32_t) data[1] << 16)
+    | ((uint32_t) data[2] << 8) | data[3];
+}
+
+static uint32_t
+read_le16(const unsigned char* data)
+{
+  return data[0] | ((uint32_t) data[1] << 8);
+}
+
+static uint32_t
+read_le24(const unsigned char* data)
+{
+  return data[0] | ((uint32_t) data[1] << 8) | ((uint32_t) data[2] << 16);
+}
+
+static uint32_t
+read_le32(const unsigned char* data)
+{
+  return read_le24(data) | ((uint32_t) data[3] << 24);
+}
+
+static cb_probe_result_t
+set_size(uint32_t width, uint32_t height, int* image_width, int* image_height)
+{
+  if (width == 0 || height == 0 || width > INT32_MAX || height > INT32_MAX) {
+    return CB_PROBE_UNKNOWN_FORMAT;
+  }
+
+  *image_width = width;
+  *image_height = height;
+  return CB_PROBE_OK;
+}
+
+static cb_probe_result_t
+probe_jpeg(const unsigned char* data, size_t length, int* width, int* height)
+{
+  /* walk the marker segments up to the start of frame */
+  size_t position = 2;
+  while (true) {
+    if (position + 2 > length) {
+      return CB_PROBE_NEED_MORE_DATA;
+    }
+
+    if (data[position] != 0xFF) {
+      return CB_PROBE_UNKNOWN_FORMAT;
+    }
+
+    const unsigned char marker = data[position + 1];
+    if (marker == 0xFF) {
+      /* fill byte */
+      position++;
+      continue;
+    }
+
+    /* markers without a segment */
+    if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8)) {
+      position += 2;
+      continue;
+    }
+
+    if (marker == 0xD9 || marker == 0xDA) {
+      /* end of image or start of scan before any frame header */
+      return CB_PROBE_UNKNOWN_FORMAT;
+    }
+
+    if (position + 4 > length) {
+      return CB_PROBE_NEED_MORE_DATA;
+    }
+
+    const uint32_t segment_length = read_be16(data + position + 2);
+    if (segment_length < 2) {
+      return CB_PROBE_UNKNOWN_FORMAT;
+    }
+
+    /* SOF0 - SOF15 except DHT, JPG and DAC */
+    if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+      if (position + 9 > length) {
+        return CB_PROBE_NEED_MORE_DATA;
+      }
+
+      return set_size(read_be16(data + position + 7), read_be16(data + position + 5), width, height);
+    }
+
+    position += 2 + segment_length;
+  }
+}
+
+static cb_probe_result_t
+probe_png(const unsigned char* data, size_t length, int* width, int* height)
+{
+  if (length < 24) {
+    return CB_PROBE_NEED_MORE_DATA;
+  }
+
+  if (memcmp(data + 12, "IHDR", 4) != 0) {
+    return CB_PROBE_UNKNOWN_FORMAT;
+  }
+
+  return set_size(read_be32(data + 16), read_be32(data + 20), width, height);
+}
+
+static cb_probe_result_t
+probe_gif(const unsigned char* data, size_t length, int* width, int* height)
+{
+  if (length < 10) {
+    return CB_PROBE_NEED_MORE_DATA;
+  }
+
+  return set_size(read_le16(data + 6), read_le16(data + 8), width, height);
+}
+
+static cb_probe_result_t
+probe_bmp(const unsigned char* data, size_t length, int* width, int* height)
+{
+  if (length < 26) {
+    return CB_PROBE_NEED_MORE_DATA;
+  }
+
+  const uint32_t header_size = read_le32(data + 14);
+  if (header_size == 12) {
+    /* OS/2 BITMAPCOREHEADER */
+    return set_size(read_le16(data + 18), read_le16(data + 20), width, height);
+  }
+
+  /* BITMAPINFOHEADER and later; the height is negative for top-down images */
+  const int32_t bmp_height = (int32_t) read_le32(data + 22);
+  return set_size(read_le32(data + 18), bmp_height < 0 ? -(int64_t) bmp_height : bmp_height,
+      width, height);
+}
+
+static cb_probe_result_t
+probe_webp(const unsigned char* data, size_t length, int* width, int* height)
+{
+  if (length < 30) {
+    return CB_PROBE_NEED_MORE_DATA;
+  }
+
+  const unsigned char* chunk = data + 12;
+  if (memcmp(chunk, "VP8 ", 4) == 0) {
+    /* lossy: key frame start code followed by 14 bit dimensions */
+    if (data[23] != 0x9D || data[24] != 0x01 || data[25] != 0x2A) {
+      return CB_PROBE_UNKNOWN_FORMAT;
+    }
+    return set_size(read_le16(data + 26) & 0x3FFF, read_le16(data + 28) & 0x3FFF, width, height);
+  } else if (memcmp(chunk, "VP8L", 4) == 0) {
+    /* lossless: signature followed by 14 bit dimensions minus one */
+    if (data[20] != 0x2F) {
+      return CB_PROBE_UNKNOWN_FORMAT;
+    }
+    const uint32_t bits = read_le32(data + 21);
+    return set_size((bits & 0x3FFF) + 1, ((bits >> 14) & 0x3FFF) + 1, width, height);
+  } else if (memcmp(chunk, "VP8X", 4) == 0) {
+    /* extended: 24 bit canvas dimensions minus one */
+    return set_size(read_le24(data + 24) + 1, read_le24(data + 27) + 1, width, height);
+  }
+
+  return CB_PROBE_UNKNOWN_FORMAT;
+}
+
+/** A box of the ISO base media file format (AVIF, JPEG XL container)
+ */
+typedef struct box_s {
+  const unsigned char* type; /**< Four character code of the box */
+  size_t start; /**< Offset of the payload */
+  size_t end; /**< Offset of the end of the box, SIZE_MAX if it extends to the end of the file */
+} box_t;
+
+static uint64_t
+read_be64(const unsigned char* data)
+{
+  return ((uint64_t) read_be32(data) << 32) | read_be32(data + 4);
+}
+
+static cb_probe_result_t
+read_box(const unsigned char* data, size_t length, size_t position, size_t end, box_t* box)
+{
+  if (end - position < 8) {
+    return CB_PROBE_UNKNOWN_FORMAT;
+  } else if (length < 8 || position > length - 8) {
+    return CB_PROBE_NEED_MORE_DATA;
+  }
+
+  uint64_t size = read_be32(data + position);
+  size_t header_size = 8;
+  if (size == 1) {
+    if (end - position < 16) {
+      return CB_PROBE_UNKNOWN_FORMAT;
+    } else if (position > length - 16) {
+      return CB_PROBE_NEED_MORE_DATA;
+    }
+    size = read_be64(data + position + 8);
+    header_size = 16;
+  }
+
+  box->type = data + position + 4;
+  box->start = position + header_size;
+  if (size == 0) {
+    /* the box extends to the end of its parent */
+    box->end = end;
+  } else if (size < header_size || size > end - position) {
+    return CB_PROBE_UNKNOWN_FORMAT;
+  } else {
+    box->end = position + size;
+  }
+
+  return CB_PROBE_OK;
+}
+
+/** Reads the bit-packed fields of a JPEG XL codestream, least significant bit first
+ */
+typedef struct bit_reader_s {
+  const unsigned char* data; /**< The data */
+  size_t length; /**< Number of bytes available */
+  size_t position; /**< Position in bits */
+  bool overflow; /**< Set if more bits were read than available */
+} bit_reader_t;
+
+static uint32_t
+read_bits(bit_reader_t* reader, unsigned int count)
+{
+  uint32_t value = 0;
+  for (unsigned int i = 0; i < count; i++, reader->position++) {
+    if (reader->position / 8 >= reader->length) {
+      reader->overflow = true;
+      return 0;
+    }
+    value |= (uint32_t) ((reader->data[reader->position / 8] >> (reader->position % 8)) & 1) << i;
+  }
+
+  return value;
+}
+
+static uint32_t
+read_jxl_dimension(bit_reader_t* reader)
+{
+  static const unsigned int bits[] = { 9, 13, 18, 30 };
+  return read_bits(reader, bits[read_bits(reader, 2)]) + 1;
+}
+
+static cb_probe_result_t
+probe_jxl_codestream(const unsigned char* data, size_t length, int* width, int* height)
+{
+  if (length < 2) {
+    return CB_PROBE_NEED_MORE_DATA;
+  } else if (data[0] != 0xFF || data[1] != 0x0A) {
+    return CB_PROBE_UNKNOWN_FORMAT;
+  }
+
+  /* SizeHeader: the height, then the width or its ratio to the height */
+  static const uint32_t ratios[8][2] = {
+    { 0, 0 }, { 1, 1 }, { 12, 10 }, { 4, 3 }, { 3, 2 }, { 16, 9 }, { 5, 4 }, { 2, 1 }
+  };
+  bit_reader_t reader = { data + 2, length - 2, 0, false };
+  const bool small = read_bits(&reader, 1) == 1;
+  const uint32_t jxl_height = small == true ? (read_bits(&reader, 5) + 1) * 8 : read_jxl_dimension(&reader);
+  const uint32_t ratio = read_bits(&reader, 3);
+  uint64_t jxl_width = 0;
+  if (ratio == 0) {
+    jxl_width = small == true ? (read_bits(&reader, 5) + 1) * 8 : read_jxl_dimension(&reader);
+  } else {
+    jxl_width = (uint64_t) jxl_height * ratios[ratio][0] / ratios[ratio][1];
+  }
+
+  /* ImageMetadata: orientations 5 to 8 transpose the image */
+  uint32_t orientation = 1;
+  if (read_bits(&reader, 1) == 0 && read_bits(&reader, 1) == 1) {
+    orientation = read_bits(&reader, 3) + 1;
+  }
+
+  if (reader.overflow == true) {
+    return CB_PROBE_NEED_MORE_DATA;
+  } else if (jxl_width > INT32_MAX) {
+    return CB_PROBE_UNKNOWN_FORMAT;
+  }
+
+  if (orientation > 4) {
+    return set_size(jxl_height, jxl_width, width, height);
+  }
+  return set_size(jxl_width, jxl_height, width, height);
+}
+
+static cb_probe_result_t
+probe_jxl_container(const unsigned char* data, size_t length, int* width, int* height)
+{
+  /* find the box holding the (first part of the) codestream */
+  size_t position = 0;
+  while (true) {
+    box_t box;
+    const cb_probe_result_t result = read_box(data, length, position, SIZE_MAX, &box);
+    if (result != CB_PROBE_OK) {
+      return result;
+    }
+
+    size_t start = box.start;
+    if (memcmp(box.type, "jxlp", 4) == 0) {
+      /* partial codestreams start with their index */
+      start += 4;
+    }
+    if (memcmp(box.type, "jxlc", 4) == 0 || memcmp(box.type, "jxlp", 4) == 0) {
+      if (start >= length) {
+        return CB_PROBE_NEED_MORE_DATA;
+      }
+
+      const size_t available = (box.end < length ? box.end : length) - (start < box.end ? start : box.end);
+      const cb_probe_result_t result = probe_jxl_codestream(data + start, available, width, height);
+      /* a header split across partial codestreams is left to the decoder */
+      if (result == CB_PROBE_NEED_MORE_DATA && box.end <= length) {
+        return CB_PROBE_UNKNOWN_FORMAT;
+      }
+      return result;
+    }
+
+    if (box.end == SIZE_MAX) {
+      return CB_PROBE_UNKNOWN_FORMAT;
+    }
+    position = box.end;
+  }
+}
+
+static cb_probe_result_t
+find_avif_property(const unsigned char* data, const box_t* ipco, uint32_t index, box_t* property)
+{
+  /* properties are numbered from 1 */
+  size_t position = ipco->start;
+  for (uint32_t i = 1; position < ipco->end; i++) {
+    if (read_box(data, ipco->end, position, ipco->end, property) != CB_PROBE_OK) {
+      return CB_PROBE_UNKNOWN_FORMAT;
+    }
+    if (i == index) {
+      return CB_PROBE_OK;
+    }
+    position = property->end;
+  }
+
+  return CB_PROBE_UNKNOWN_FORMAT;
+}
+
+static cb_probe_result_t
+probe_avif_meta(const unsigned char* data, const box_t* meta, int* width, int* height)
+{
+  /* the size of the primary item is given by the image spatial extents
+   * property associated with it, and its rotation by irot */
+  box_t ipco = { NULL, 0, 0 };
+  box_t ipma = { NULL, 0, 0 };
+  uint64_t primary_item = UINT64_MAX;
+  size_t position = meta->start + 4;
+  while (position < meta->end) {
+    box_t box;
+    if (read_box(data, meta->end, position, meta->end, &box) != CB_PROBE_OK) {
+      return CB_PROBE_UNKNOWN_FORMAT;
+    }
+
+    if (memcmp(box.type, "pitm", 4) == 0 && box.end - box.start >= 6) {
+      primary_item = data[box.start] == 0 ? read_be16(data + box.start + 4) : (box.end - box.start >= 8
+          ? read_be32(data + box.start + 4) : UINT64_MAX);
+    } else if (memcmp(box.type, "iprp", 4) == 0) {
+      size_t child = box.start;
+      while (child < box.end) {
+        box_t property;
+        if (read_box(data, box.end, child, box.end, &property) != CB_PROBE_OK) {
+          return CB_PROBE_UNKNOWN_FORMAT;
+        }
+        if (memcmp(property.type, "ipco", 4) == 0) {
+          ipco = property;
+        } else if (memcmp(property.type, "ipma", 4) == 0) {
+          ipma = property;
+        }
+        child = property.end;
+      }
+    }
+    position = box.end;
+  }
+
+  if (primary_item == UINT64_MAX || ipco.type == NULL || ipma.type == NULL
+      || ipma.end - ipma.start < 8) {
+    return CB_PROBE_UNKNOWN_FORMAT;
+  }
+
+  const unsigned int version = data[ipma.start];
+  const bool large_index = (data[ipma.start + 3] & 1) != 0;
+  const uint32_t entries = read_be32(data + ipma.start + 4);
+  position = ipma.start + 8;
+
+  uint32_t ispe_width = 0;
+  uint32_t ispe_height = 0;
+  bool rotated = false;
+  for (uint32_t i = 0; i < entries; i++) {
+    const size_t id_size = version < 1 ? 2 : 4;
+    if (ipma.end - position < id_size + 1) {
+      return CB_PROBE_UNKNOWN_FORMAT;
+    }
+    const uint32_t item = id_size == 2 ? read_be16(data + position) : read_be32(data + position);
+    const unsigned int associations = data[position + id_size];
+    position += id_size + 1;
+
+    const size_t index_size = large_index == true ? 2 : 1;
+    if ((ipma.end - position) / index_size < associations) {
+      return CB_PROBE_UNKNOWN_FORMAT;
+    }
+    for (unsigned int j = 0; j < associations && item == primary_item; j++) {
+      const uint32_t index = large_index == true ? read_be16(data + position + j * 2) & 0x7FFF
+        : data[position + j] & 0x7Fu;
+      box_t property;
+      if (index == 0 || find_avif_property(data, &ipco, index, &property) != CB_PROBE_OK) {
+        continue;
+      }
+      if (memcmp(property.type, "ispe", 4) == 0 && property.end - property.start >= 12) {
+        ispe_width = read_be32(data + property.start + 4);
+        ispe_height = read_be32(data + property.start + 8);
+      } else if (memcmp(property.type, "irot", 4) == 0 && property.end > property.start) {
+        rotated = (data[property.start] & 1) != 0;
+      }
+    }
+    position += associations * index_size;
+  }
+
+  if (rotated == true) {
+    return set_size(ispe_height, ispe_width, width, height);
+  }
+  return set_size(ispe_width, ispe_height, width, height);
+}
+
+static bool
+is_avif_brand(const unsigned char* brand)
+{
+  return memcmp(brand, "avif", 4) == 0 || memcmp(brand, "avis", 4) == 0;
+}
+
+static cb_probe_result_t
+probe_avif(const unsigned char* data, size_t length, int* width, int* height)
+{
+  box_t ftyp;
+  cb_probe_result_t result = read_box(data, length, 0, SIZE_MAX, &ftyp);
+  if (result != CB_PROBE_OK) {
+    return result;
+  } else if (ftyp.end > length) {
+    return CB_PROBE_NEED_MORE_DATA;
+  }
+
+  /* the major brand is followed by the minor version and the compatible
+   * brands */
+  bool is_avif = ftyp.end - ftyp.start >= 4 && is_avif_brand(data + ftyp.start);
+  for (size_t position = ftyp.start + 8; position + 4 <= ftyp.end; position += 4) {
+    is_avif = is_avif == true || is_avif_brand(data + position);
+  }
+  if (is_avif == false) {
+    return CB_PROBE_UNKNOWN_FORMAT;
+  }
+
+  size_t position = ftyp.end;
+  while (true) {
+    box_t box;
+    result = read_box(data, length, position, SIZE_MAX, &box);
+    if (result != CB_PROBE_OK) {
+      return result;
+    }
+
+    if (memcmp(box.type, "meta", 4) == 0) {
+      if (box.end > length) {
+        return CB_PROBE_NEED_MORE_DATA;
+      }
+      return probe_avif_meta(data, &box, width, height);
+    }
+
+    if (box.end == SIZE_MAX) {
+      return CB_PROBE_UNKNOWN_FORMAT;
+    }
+    position = box.end;
+  }
+}
+
+cb_probe_result_t
+cb_probe_image_size(const unsigned char* data, size_t length, int* width, int* height)
+{
+  if (data == NULL || width == NULL || height == NULL) {
+    return CB_PROBE_UNKNOWN_FORMAT;
+  }
+
+  if (length < 12) {
+    return CB_PROBE_NEED_MORE_DATA;
+  }
+
+  if (data[0] == 0xFF && data[1] == 0xD8) {
+    return probe_jpeg(data, length, width, height);
+  } else if (memcmp(data, "\x89PNG\r\n\x1a\n", 8) == 0) {
+    return probe_png(data, length, width, height);
+  } else if (memcmp(data, "GIF87a", 6) == 0 || memcmp(data, "GIF89a", 6) == 0) {
+    return probe_gif(data, length, width, height);
+  } else if (memcmp(data, "RIFF", 4) == 0 && memcmp(data + 8, "WEBP", 4) == 0) {
+    return probe_webp(data, length, width, height);
+  } else if (data[0] == 'B' && data[1] == 'M') {
+    return probe_bmp(data, length, width, height);
+  } else if (data[0] == 0xFF && data[1] == 0x0A) {
+    return probe_jxl_codestream(data, length, width, height);
+  } else if (memcmp(data, "\0\0\0\x0cJXL \r\n\x87\n", 12) == 0) {
+    return probe_jxl_container(data, length, width, height);
+  } else if (memcmp(data + 4, "ftyp", 4) == 0) {
+    return probe_avif(data, length, width, height);
+  }
+
+  return CB_PROBE_UNKNOWN_FORMAT;
+}
@@ -0,0 +1,32 @@
+/* See LICENSE file for license and copyright information */
+
+#ifndef PROBE_H
+#define PROBE_H
+
+#include <stddef.h>
+
+#include <girara/macros.h>
+
+/* Maximum number of bytes of an image buffered while looking for its size */
+#define CB_PROBE_MAX_HEADER_SIZE (256 * 1024)
+
+typedef enum cb_probe_result_e {
+  CB_PROBE_OK, /**< The size has been found */
+  CB_PROBE_NEED_MORE_DATA, /**< The header is incomplete */
+  CB_PROBE_UNKNOWN_FORMAT /**< The image format is not supported or the header is invalid */
+} cb_probe_result_t;
+
+/**
+ * Determines the size of an image from the first bytes of its file. Supported
+ * formats are JPEG, PNG, WebP, GIF, BMP, JPEG XL and AVIF.
+ *
+ * @param data Start of the image file
+ * @param length Number of bytes available
+ * @param width Set to the width of the image
+ * @param height Set to the height of the image
+ * @return CB_PROBE_OK if the size has been found
+ */
+GIRARA_HIDDEN cb_probe_result_t cb_probe_image_size(const unsigned char* data, size_t length,
+    int* width, int* height);
+
+#endif // PROBE_H
@@ -0,0 +1,396 @@
+/* See LICENSE file for license and copyright information */
+
+#include <glib.h>
+#include <archive.h>
+#include <archive_entry.h>
+#include <string.h>
+
+#include "reader.h"
+#include "source.h"
+#include "spool.h"
+#include "trace.h"
+
+/** An open archive and its position
+ */
+typedef struct cb_reader_handle_s {
+  struct archive* archive; /**< Open archive, NULL if closed */
+  unsigned int next_entry; /**< Position of the next header in the archive */
+} cb_reader_handle_t;
+
+struct cb_reader_s {
+  cb_source_t* source; /**< The archive file */
+  cb_zip_t* zip; /**< Central directory of a zip archive, NULL if not read */
+  GArray* pages; /**< Meta-data of the pages */
+  int format; /**< libarchive format code of the archive */
+  int filter; /**< libarchive code of the outermost filter */
+  size_t spool_memory_limit; /**< Memory limit of the spool */
+  unsigned int max_handles; /**< Maximum number of handles */
+  GMutex lock; /**< Protects the members below */
+  GCond released; /**< Signalled when a handle is returned */
+  cb_spool_t* spool; /**< Extracted pages of a solid archive, created on first use */
+  GQueue idle; /**< Handles not in use, most recently used first */
+  unsigned int handles; /**< Number of handles, in use or idle */
+};
+
+static void
+reader_close(cb_reader_handle_t* handle)
+{
+  if (handle->archive != NULL) {
+    archive_read_close(handle->archive);
+    archive_read_free(handle->archive);
+    handle->archive = NULL;
+  }
+
+  handle->next_entry = 0;
+}
+
+static bool
+is_solid(cb_reader_t* reader)
+{
+  /* libarchive does not report whether a rar or 7z archive is solid, so
+   * assume it is; a compressed tar stream is solid by nature */
+  switch (reader->format & ARCHIVE_FORMAT_BASE_MASK) {
+    case ARCHIVE_FORMAT_RAR:
+    case ARCHIVE_FORMAT_RAR_V5:
+    case ARCHIVE_FORMAT_7ZIP:
+      return true;
+    default:
+      return reader->filter != ARCHIVE_FILTER_NONE;
+  }
+}
+
+static bool
+can_open_at_header(cb_reader_t* reader, const cb_document_page_meta_t* meta)
+{
+  /* An uncompressed tar stream can be restarted at any header, so the recorded
+   * header offset can be used directly. For all other archives the offset
+   * reported by libarchive is either relative to a decompressed stream or not
+   * the offset of the local header at all. */
+  return meta->header_offset >= 0
+    && reader->filter == ARCHIVE_FILTER_NONE
+    && (reader->format & ARCHIVE_FORMAT_BASE_MASK) == ARCHIVE_FORMAT_TAR;
+}
+
+static bool
+reader_open_at_header(cb_reader_t* reader, cb_reader_handle_t* handle,
+    const cb_document_page_meta_t* meta)
+{
+  handle->archive = cb_source_open_archive(reader->source, meta->header_offset, true);
+  if (handle->archive == NULL) {
+    return false;
+  }
+
+  handle->next_entry = meta->entry;
+  return true;
+}
+
+static bool
+reader_open(cb_reader_t* reader, cb_reader_handle_t* handle)
+{
+  handle->archive = cb_source_open_archive(reader->source, 0, false);
+  if (handle->archive == NULL) {
+    return false;
+  }
+
+  handle->next_entry = 0;
+  return true;
+}
+
+static bool
+reader_seek(cb_reader_t* reader, cb_reader_handle_t* handle, const cb_document_page_meta_t* meta)
+{
+  if (handle->archive != NULL && handle->next_entry == meta->entry) {
+    return true;
+  }
+
+  if (can_open_at_header(reader, meta) == true) {
+    reader_close(handle);
+    if (reader_open_at_header(reader, handle, meta) == true) {
+      return true;
+    }
+  }
+
+  /* going backwards requires starting over */
+  if (handle->archive == NULL || handle->next_entry > meta->entry) {
+    reader_close(handle);
+    if (reader_open(reader, handle) == false) {
+      return false;
+    }
+  }
+
+  /* Skip forward by position. The data of skipped entries is never read; for
+   * seekable formats (zip, 7z) libarchive seeks over it. */
+  struct archive_entry* entry = NULL;
+  while (handle->next_entry < meta->entry) {
+    if (archive_read_next_header(handle->archive, &entry) < ARCHIVE_WARN) {
+      reader_close(handle);
+      return false;
+    }
+    handle->next_entry++;
+  }
+
+  return true;
+}
+
+/* must be called with the lock held */
+static cb_reader_handle_t*
+find_idle_handle(cb_reader_t* reader, const cb_document_page_meta_t* meta)
+{
+  /* prefer the handle that is closest before the entry, it has the least
+   * to skip */
+  GList* best = NULL;
+  for (GList* link = reader->idle.head; link != NULL; link = link->next) {
+    const cb_reader_handle_t* handle = link->data;
+    if (handle->archive != NULL && handle->next_entry <= meta->entry
+        && (best == NULL || handle->next_entry > ((cb_reader_handle_t*) best->data)->next_entry)) {
+      best = link;
+    }
+  }
+
+  if (best == NULL) {
+    return NULL;
+  }
+
+  cb_reader_handle_t* handle = best->data;
+  g_queue_delete_link(&reader->idle, best);
+  return handle;
+}
+
+static cb_reader_handle_t*
+reader_acquire(cb_reader_t* reader, const cb_document_page_meta_t* meta)
+{
+  g_mutex_lock(&reader->lock);
+
+  cb_reader_handle_t* handle = NULL;
+  while ((handle = find_idle_handle(reader, meta)) == NULL) {
+    if (reader->handles < reader->max_handles) {
+      /* opened by reader_seek */
+      handle = g_malloc0(sizeof(cb_reader_handle_t));
+      reader->handles++;
+      break;
+    } else if (g_queue_is_empty(&reader->idle) == false) {
+      /* no handle is positioned before the entry, reuse the most recently
+       * used one */
+      handle = g_queue_pop_head(&reader->idle);
+      break;
+    }
+
+    g_cond_wait(&reader->released, &reader->lock);
+  }
+
+  g_mutex_unlock(&reader->lock);
+
+  return handle;
+}
+
+static void
+reader_release(cb_reader_t* reader, cb_reader_handle_t* handle)
+{
+  g_mutex_lock(&reader->lock);
+  g_queue_push_head(&reader->idle, handle);
+  g_cond_signal(&reader->released);
+  g_mutex_unlock(&reader->lock);
+}
+
+static void
+reader_handle_free(cb_reader_handle_t* handle)
+{
+  reader_close(handle);
+  g_free(handle);
+}
+
+cb_reader_t*
+cb_reader_new(cb_source_t* source, cb_zip_t* zip, GArray* pages, int format, int filter,
+    unsigned int max_handles, size_t spool_memory_limit)
+{
+  cb_reader_t* reader = g_malloc0(sizeof(cb_reader_t));
+
+  reader->source = source;
+  reader->zip = zip;
+  reader->pages = pages;
+  reader->format = format;
+  reader->filter = filter;
+  reader->spool_memory_limit = spool_memory_limit;
+  reader->max_handles = MAX(max_handles, 1);
+  g_mutex_init(&reader->lock);
+  g_cond_init(&reader->released);
+  g_queue_init(&reader->idle);
+
+  return reader;
+}
+
+void
+cb_reader_free(cb_reader_t* reader)
+{
+  if (reader == NULL) {
+    return;
+  }
+
+  g_queue_clear_full(&reader->idle, (GDestroyNotify) reader_handle_free);
+  cb_spool_free(reader->spool);
+  g_cond_clear(&reader->released);
+  g_mutex_clear(&reader->lock);
+  g_free(reader);
+}
+
+static void*
+read_data(struct archive* a, int64_t expected_size, size_t* size)
+{
+  /* read straight into a buffer of the size recorded in the index */
+  if (expected_size >= 0) {
+    if ((uint64_t) expected_size > G_MAXSIZE - 1) {
+      return NULL;
+    }
+
+    unsigned char* data = g_try_malloc(MAX(expected_size, 1));
+    if (data == NULL) {
+      return NULL;
+    }
+
+    size_t length = 0;
+    while (length < (size_t) expected_size) {
+      const la_ssize_t r = archive_read_data(a, data + length, expected_size - length);
+      if (r < 0) {
+        g_free(data);
+        return NULL;
+      } else if (r == 0) {
+        break;
+      }
+      length += r;
+    }
+
+    *size = length;
+    return data;
+  }
+
+  /* the size is not stored in the archive, grow the buffer as needed */
+  unsigned char* data = NULL;
+  size_t capacity = 0;
+  size_t length = 0;
+
+  int r = 0;
+  size_t block_size = 0;
+  const void* buf = NULL;
+  __LA_INT64_T offset = 0;
+  while ((r = archive_read_data_block(a, &buf, &block_size, &offset)) != ARCHIVE_EOF) {
+    if (r < ARCHIVE_WARN) {
+      g_free(data);
+      return NULL;
+    }
+
+    if (block_size == 0 || buf == NULL) {
+      continue;
+    }
+
+    if (length + block_size > capacity) {
+      capacity = MAX(capacity * 2, length + block_size);
+      unsigned char* tmp = g_try_realloc(data, capacity);
+      if (tmp == NULL) {
+        g_free(data);
+        return NULL;
+      }
+      data = tmp;
+    }
+
+    memcpy(data + length, buf, block_size);
+    length += block_size;
+  }
+
+  *size = length;
+  return data;
+}
+
+static void*
+reader_read_entry(cb_reader_t* reader, cb_reader_handle_t* handle,
+    const cb_document_page_meta_t* meta, size_t* size)
+{
+  CB_TRACE_BEGIN(seek_span, "seek");
+  if (reader_seek(reader, handle, meta) == false) {
+    CB_TRACE_END(seek_span, "error", 1);
+    return NULL;
+  }
+
+  struct archive_entry* entry = NULL;
+  int r = archive_read_next_header(handle->archive, &entry);
+  if (r < ARCHIVE_WARN || r == ARCHIVE_EOF) {
+    CB_TRACE_END(seek_span, "error", 1);
+    reader_close(handle);
+    return NULL;
+  }
+  handle->next_entry++;
+  CB_TRACE_END(seek_span, "entry", meta->entry);
+
+  /* the index should always point at the right entry; check it anyway. The
+   * paths of zip entries listed from the central directory may have been
+   * converted from their legacy encoding differently than libarchive does,
+   * so their size is compared instead. */
+  const bool matches = reader->zip != NULL
+    ? archive_entry_size_is_set(entry) == 0 || archive_entry_size(entry) == meta->size
+    : g_strcmp0(archive_entry_pathname(entry), meta->file) == 0;
+  if (matches == false) {
+    reader_close(handle);
+    return NULL;
+  }
+
+  CB_TRACE_BEGIN(inflate_span, "inflate");
+  void* data = read_data(handle->archive, meta->size, size);
+  if (data == NULL) {
+    CB_TRACE_END(inflate_span, "error", 1);
+    /* the stream is in an undefined state now */
+    reader_close(handle);
+    return NULL;
+  }
+  CB_TRACE_END(inflate_span, "bytes", *size);
+
+  return data;
+}
+
+void*
+cb_reader_read_entry(cb_reader_t* reader, const cb_document_page_meta_t* meta, size_t* size,
+    bool* verified)
+{
+  if (reader == NULL || meta == NULL || size == NULL || verified == NULL) {
+    return NULL;
+  }
+  *verified = false;
+
+  /* a zip entry is located through the central directory and read at once,
+   * no matter where it is in the archive */
+  if (reader->zip != NULL) {
+    CB_TRACE_BEGIN(zip_span, "zip_read");
+    void* data = cb_zip_read_entry(reader->zip,
+        cb_zip_get_entry_by_position(reader->zip, meta->entry), 0, size);
+    if (data != NULL) {
+      CB_TRACE_END(zip_span, "bytes", *size);
+      /* whole entries are checked against their CRC-32 */
+      *verified = true;
+      return data;
+    }
+    CB_TRACE_END(zip_span, "error", 1);
+  }
+
+  g_mutex_lock(&reader->lock);
+  if (reader->spool == NULL && is_solid(reader) == true) {
+    reader->spool = cb_spool_new(reader->source, reader->pages, reader->spool_memory_limit);
+  }
+  cb_spool_t* spool = reader->spool;
+  g_mutex_unlock(&reader->lock);
+
+  if (spool != NULL) {
+    CB_TRACE_BEGIN(spool_span, "spool_read");
+    void* data = cb_spool_read_entry(spool, meta, size);
+    if (data != NULL) {
+      CB_TRACE_END(spool_span, "bytes", *size);
+      return data;
+    }
+    CB_TRACE_END(spool_span, "error", 1);
+
+    /* extraction failed, read the entry directly */
+  }
+
+  cb_reader_handle_t* handle = reader_acquire(reader, meta);
+  void* data = reader_read_entry(reader, handle, meta, size);
+  reader_release(reader, handle);
+
+  return data;
+}
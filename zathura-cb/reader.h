@@ -0,0 +1,64 @@
+/* See LICENSE file for license and copyright information */
+
+#ifndef READER_H
+#define READER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <girara/macros.h>
+
+#include "plugin.h"
+#include "internal.h"
+#include "source.h"
+#include "zip.h"
+
+typedef struct cb_reader_s cb_reader_t;
+
+/**
+ * Creates a reader that keeps a pool of archive handles open between reads.
+ * Each read checks out the idle handle positioned closest before the
+ * requested entry, so entries read in archive order are served from a single
+ * pass and a handle is only reopened when an entry before its position is
+ * requested. Up to max_handles reads proceed in parallel; further reads wait
+ * for a handle to be returned. Solid archives are extracted into a spool on
+ * the first read instead (see cb_spool_new). Entries of zip archives whose
+ * central directory has been read are read directly (see cb_zip_read_entry),
+ * libarchive is only used for entries that cannot be read that way.
+ *
+ * @param source The archive file; it must outlive the reader
+ * @param zip Central directory of the archive or NULL; it must outlive the reader
+ * @param pages Array of cb_document_page_meta_t; it must outlive the reader
+ * @param format libarchive format code of the archive
+ * @param filter libarchive code of the outermost filter of the archive
+ * @param max_handles Maximum number of archive handles open at the same time
+ * @param spool_memory_limit Maximum number of bytes of a spool kept in memory
+ * @return The reader
+ */
+GIRARA_HIDDEN cb_reader_t* cb_reader_new(cb_source_t* source, cb_zip_t* zip, GArray* pages,
+    int format, int filter, unsigned int max_handles, size_t spool_memory_limit);
+
+/**
+ * Closes all archive handles and frees the reader. No read may be in
+ * progress.
+ *
+ * @param reader The reader
+ */
+GIRARA_HIDDEN void cb_reader_free(cb_reader_t* reader);
+
+/**
+ * Reads the data of a page into a single buffer. This may be called from any
+ * thread; concurrent reads use separate archive handles and only wait for
+ * each other if all handles are in use.
+ *
+ * @param reader The reader
+ * @param meta Meta-data of the page
+ * @param size Set to the size of the data
+ * @param verified Set to true if the data has been checked against the
+ *   CRC-32 of the entry, false otherwise
+ * @return The data, to be freed with g_free, or NULL if an error occurred
+ */
+GIRARA_HIDDEN void* cb_reader_read_entry(cb_reader_t* reader, const cb_document_page_meta_t* meta,
+    size_t* size, bool* verified);
+
+#endif // READER_H
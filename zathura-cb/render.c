@@ -1,20 +1,36 @@
 /* See LICENSE file for license and copyright information */
 
-#include <gio/gio.h>
-#include <archive.h>
-#include <archive_entry.h>
 #include <gtk/gtk.h>
-#include <string.h>
+#include <math.h>
 
 #include "plugin.h"
 #include "internal.h"
-#include "utils.h"
+#include "convert.h"
+#include "decode.h"
+#include "prefetch.h"
+#include "reader.h"
+#include "render.h"
+#include "scale.h"
+#include "thumbnails.h"
+#include "trace.h"
 
-static GdkPixbuf* load_pixbuf_from_archive(const char* archive, const char* file);
+static GdkPixbuf* load_pixbuf_from_data(const void* data, size_t size, unsigned int level);
+static cairo_surface_t* load_surface_from_archive(const cb_document_t* cb_document,
+    const cb_document_page_meta_t* meta, unsigned int level);
+static cairo_surface_t* load_surface_from_data(const cb_document_t* cb_document,
+    const void* data, size_t size, unsigned int level, bool verified);
+static bool get_thumbnail_size(cb_document_t* cb_document, const cb_document_page_meta_t* meta,
+    unsigned int level, unsigned int* size, unsigned int* thumbnail_level);
+static cairo_surface_t* load_surface_from_thumbnails(cb_document_t* cb_document,
+    const cb_document_page_meta_t* meta, unsigned int size, unsigned int thumbnail_level);
+static unsigned int get_scale_level(cairo_t* cairo);
+static cairo_surface_t* surface_from_pixbuf(GdkPixbuf* pixbuf);
+static cairo_surface_t* convert_pixbuf(GdkPixbuf* pixbuf);
+static cairo_surface_t* scale_to_device(cairo_t* cairo, cairo_surface_t* surface);
 
 zathura_error_t
 cb_page_render_cairo(zathura_page_t* page, void* data,
-    cairo_t* cairo, bool UNUSED(printing))
+    cairo_t* cairo, bool printing)
 {
   cb_page_t* cb_page = data;
   if (page == NULL || cb_page == NULL || cairo == NULL) {
@@ -26,101 +42,335 @@ cb_page_render_cairo(zathura_page_t* page, void* data,
     return ZATHURA_ERROR_UNKNOWN;
   }
 
-  GdkPixbuf* pixbuf = load_pixbuf_from_archive(zathura_document_get_path(document), cb_page->file);
-  if (pixbuf == NULL) {
+  cb_document_t* cb_document = zathura_document_get_data(document);
+  if (cb_document == NULL) {
     return ZATHURA_ERROR_UNKNOWN;
   }
 
-  gdk_cairo_set_source_pixbuf(cairo, pixbuf, 0, 0);
+  const unsigned int index = zathura_page_get_index(page);
+  const unsigned int level = printing == true ? 0 : get_scale_level(cairo);
+  cb_prefetch_schedule(cb_document->prefetch, index, level);
+
+  cairo_surface_t* surface = cb_cache_lookup(cb_document->cache, index, level);
+  if (surface == NULL) {
+    CB_TRACE_INSTANT("cache_miss", "page", index);
+    CB_TRACE_BEGIN(load_span, "load_surface");
+    surface = cb_page_load_surface(cb_document, cb_page->meta, level);
+    if (surface == NULL) {
+      CB_TRACE_END(load_span, "error", 1);
+      return ZATHURA_ERROR_UNKNOWN;
+    }
+    CB_TRACE_END(load_span, "page", index);
+
+    cb_cache_insert(cb_document->cache, index, level, surface);
+  } else {
+    CB_TRACE_INSTANT("cache_hit", "page", index);
+  }
+
+  /* The image may have been decoded at a reduced size, or, with fast open,
+   * the page may have been laid out with the default size of the document.
+   * Fit the image into the page in both cases. */
+  const double page_width = zathura_page_get_width(page);
+  const double page_height = zathura_page_get_height(page);
+  const int image_width = cairo_image_surface_get_width(surface);
+  const int image_height = cairo_image_surface_get_height(surface);
+  if (page_width != image_width || page_height != image_height) {
+    const double scale = MIN(page_width / image_width, page_height / image_height);
+    cairo_translate(cairo, (page_width - image_width * scale) / 2,
+        (page_height - image_height * scale) / 2);
+    cairo_scale(cairo, scale, scale);
+  }
+
+  if (printing == false) {
+    CB_TRACE_BEGIN(scale_span, "scale");
+    cairo_surface_t* scaled = scale_to_device(cairo, surface);
+    if (scaled != NULL) {
+      cairo_surface_destroy(surface);
+      surface = scaled;
+      CB_TRACE_END(scale_span, "width", cairo_image_surface_get_width(scaled));
+    } else {
+      /* the image is painted as is and scaled by cairo */
+      CB_TRACE_END(scale_span, "width", 0);
+    }
+  }
+
+  CB_TRACE_BEGIN(paint_span, "paint");
+  cairo_set_source_surface(cairo, surface, 0, 0);
   cairo_paint(cairo);
-  g_object_unref(pixbuf);
+  cairo_surface_destroy(surface);
+  CB_TRACE_END(paint_span, "page", index);
 
   return ZATHURA_ERROR_OK;
 }
 
-static GdkPixbuf*
-load_pixbuf_from_archive(const char* archive, const char* file)
+static unsigned int
+get_scale_level(cairo_t* cairo)
 {
-  if (archive == NULL || file == NULL) {
+  /* device pixels per image pixel */
+  double dx = 1;
+  double dy = 0;
+  cairo_user_to_device_distance(cairo, &dx, &dy);
+  double scale = hypot(dx, dy);
+
+  double device_scale_x = 1;
+  double device_scale_y = 1;
+  cairo_surface_get_device_scale(cairo_get_target(cairo), &device_scale_x, &device_scale_y);
+  scale *= MAX(device_scale_x, device_scale_y);
+
+  /* pick the smallest reduction that still has at least the needed size */
+  unsigned int level = 0;
+  while (level < CB_MAX_SCALE_LEVEL && scale * (1 << (level + 1)) <= 1) {
+    level++;
+  }
+
+  return level;
+}
+
+static cairo_surface_t*
+scale_to_device(cairo_t* cairo, cairo_surface_t* surface)
+{
+  /* only plain scaling to an image surface can be done in advance */
+  cairo_matrix_t matrix;
+  cairo_get_matrix(cairo, &matrix);
+  cairo_surface_t* target = cairo_get_target(cairo);
+  if (cairo_surface_get_type(target) != CAIRO_SURFACE_TYPE_IMAGE
+      || matrix.xy != 0 || matrix.yx != 0 || matrix.xx <= 0 || matrix.yy <= 0) {
     return NULL;
   }
 
-  struct archive* a = archive_read_new();
-  if (a == NULL) {
+  double device_scale_x = 1;
+  double device_scale_y = 1;
+  cairo_surface_get_device_scale(target, &device_scale_x, &device_scale_y);
+
+  /* leave enlargements to cairo */
+  const int image_width = cairo_image_surface_get_width(surface);
+  const int image_height = cairo_image_surface_get_height(surface);
+  const int width = lround(image_width * matrix.xx * device_scale_x);
+  const int height = lround(image_height * matrix.yy * device_scale_y);
+  if (width <= 0 || height <= 0 || width >= image_width || height >= image_height) {
     return NULL;
   }
 
-  archive_read_support_filter_all(a);
-  archive_read_support_format_all(a);
-  int r = archive_read_open_filename(a, archive, LIBARCHIVE_BUFFER_SIZE);
-  if (r != ARCHIVE_OK) {
+  /* reduce the image to the size it covers on the device, so that cairo
+   * paints it without resampling */
+  cairo_surface_t* scaled = cb_scale_surface(surface, width, height);
+  if (scaled != NULL) {
+    cairo_scale(cairo, (double) image_width / width, (double) image_height / height);
+  }
+
+  return scaled;
+}
+
+cairo_surface_t*
+cb_page_load_surface(cb_document_t* cb_document, const cb_document_page_meta_t* meta,
+    unsigned int level)
+{
+  if (cb_document == NULL || meta == NULL) {
     return NULL;
   }
 
-  struct archive_entry* entry = NULL;
-  while ((r = archive_read_next_header(a, &entry)) != ARCHIVE_EOF) {
-    if (r < ARCHIVE_WARN) {
-      archive_read_close(a);
-      archive_read_free(a);
-      return NULL;
-    }
+  /* pages displayed at a small size come from their on-disk renditions */
+  unsigned int size = 0;
+  unsigned int thumbnail_level = 0;
+  if (cb_document->thumbnails != NULL
+      && get_thumbnail_size(cb_document, meta, level, &size, &thumbnail_level) == true) {
+    return load_surface_from_thumbnails(cb_document, meta, size, thumbnail_level);
+  }
+
+  return load_surface_from_archive(cb_document, meta, level);
+}
+
+static cairo_surface_t*
+convert_pixbuf(GdkPixbuf* pixbuf)
+{
+  CB_TRACE_BEGIN(span, "convert");
+  cairo_surface_t* surface = surface_from_pixbuf(pixbuf);
+  if (surface != NULL) {
+    CB_TRACE_END(span, "pixels", (int64_t) gdk_pixbuf_get_width(pixbuf) * gdk_pixbuf_get_height(pixbuf));
+  } else {
+    CB_TRACE_END(span, "error", 1);
+  }
+  g_object_unref(pixbuf);
+
+  return surface;
+}
+
+static cairo_surface_t*
+surface_from_pixbuf(GdkPixbuf* pixbuf)
+{
+  const int width = gdk_pixbuf_get_width(pixbuf);
+  const int height = gdk_pixbuf_get_height(pixbuf);
+  const bool has_alpha = gdk_pixbuf_get_has_alpha(pixbuf) == TRUE;
+
+  if (gdk_pixbuf_get_n_channels(pixbuf) != (has_alpha == true ? 4 : 3)
+      || gdk_pixbuf_get_bits_per_sample(pixbuf) != 8) {
+    return NULL;
+  }
+
+  cairo_surface_t* surface = cairo_image_surface_create(
+      has_alpha == true ? CAIRO_FORMAT_ARGB32 : CAIRO_FORMAT_RGB24, width, height);
+  if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS) {
+    cairo_surface_destroy(surface);
+    return NULL;
+  }
+
+  /* convert straight into the surface instead of going through
+   * gdk_cairo_set_source_pixbuf, which creates and converts a temporary one */
+  cairo_surface_flush(surface);
+  const guint8* src = gdk_pixbuf_read_pixels(pixbuf);
+  const int src_stride = gdk_pixbuf_get_rowstride(pixbuf);
+  unsigned char* dst = cairo_image_surface_get_data(surface);
+  const int dst_stride = cairo_image_surface_get_stride(surface);
 
-    const char* path = archive_entry_pathname(entry);
-    if (compare_path(path, file) != 0) {
-      continue;
+  for (int y = 0; y < height; y++) {
+    uint32_t* row = (uint32_t*) (dst + (size_t) y * dst_stride);
+    if (has_alpha == true) {
+      cb_convert_rgba_to_argb(src + (size_t) y * src_stride, row, width);
+    } else {
+      cb_convert_rgb_to_xrgb(src + (size_t) y * src_stride, row, width);
     }
+  }
+  cairo_surface_mark_dirty(surface);
+
+  return surface;
+}
+
+static void
+set_pixbuf_size(GdkPixbufLoader* loader, int width, int height, gpointer data)
+{
+  const unsigned int level = GPOINTER_TO_UINT(data);
+
+  /* loaders that support it (e.g. JPEG) decode directly at the reduced size */
+  gdk_pixbuf_loader_set_size(loader, MAX(width >> level, 1), MAX(height >> level, 1));
+}
+
+static cairo_surface_t*
+load_surface_from_archive(const cb_document_t* cb_document, const cb_document_page_meta_t* meta,
+    unsigned int level)
+{
+  if (cb_document == NULL || meta == NULL) {
+    return NULL;
+  }
 
-    GInputStream* is = g_memory_input_stream_new();
-    if (is == NULL) {
-      archive_read_close(a);
-      archive_read_free(a);
-      return NULL;
+  size_t size = 0;
+  bool verified = false;
+  CB_TRACE_BEGIN(span, "read_entry");
+  void* data = cb_reader_read_entry(cb_document->reader, meta, &size, &verified);
+  if (data == NULL) {
+    CB_TRACE_END(span, "error", 1);
+    return NULL;
+  }
+  CB_TRACE_END(span, "bytes", size);
+
+  cairo_surface_t* surface = load_surface_from_data(cb_document, data, size, level, verified);
+  g_free(data);
+
+  return surface;
+}
+
+static cairo_surface_t*
+load_surface_from_data(const cb_document_t* cb_document, const void* data, size_t size,
+    unsigned int level, bool verified)
+{
+  /* the built-in decoders write straight into the surface */
+  if (cb_document->native_decode == true) {
+    CB_TRACE_BEGIN(span, "decode_native");
+    cairo_surface_t* surface = cb_decode_image(data, size, level, verified,
+        cb_document->decode_threads);
+    if (surface != NULL) {
+      CB_TRACE_END(span, "bytes", size);
+      return surface;
     }
-    GMemoryInputStream* mis = G_MEMORY_INPUT_STREAM(is);
-
-    size_t size = 0;
-    const void* buf = NULL;
-    __LA_INT64_T offset = 0;
-    while ((r = archive_read_data_block(a, &buf, &size, &offset)) != ARCHIVE_EOF) {
-      if (r < ARCHIVE_WARN) {
-        archive_read_close(a);
-        archive_read_free(a);
-        g_object_unref(mis);
-        return NULL;
-      }
-
-      if (size == 0 || buf == NULL) {
-        continue;
-      }
-
-      void* tmp = g_malloc0(size);
-      if (tmp == NULL) {
-        archive_read_close(a);
-        archive_read_free(a);
-        g_object_unref(mis);
-        return NULL;
-      }
-
-      memcpy(tmp, buf, size);
-      g_memory_input_stream_add_data(mis, tmp, size, g_free);
+    CB_TRACE_END(span, "error", 1);
+  }
+
+  CB_TRACE_BEGIN(span, "decode");
+  GdkPixbuf* pixbuf = load_pixbuf_from_data(data, size, level);
+  if (pixbuf == NULL) {
+    CB_TRACE_END(span, "error", 1);
+    return NULL;
+  }
+  CB_TRACE_END(span, "bytes", size);
+
+  return convert_pixbuf(pixbuf);
+}
+
+static GdkPixbuf*
+load_pixbuf_from_data(const void* data, size_t size, unsigned int level)
+{
+  GdkPixbufLoader* loader = gdk_pixbuf_loader_new();
+  if (level > 0) {
+    g_signal_connect(loader, "size-prepared", G_CALLBACK(set_pixbuf_size), GUINT_TO_POINTER(level));
+  }
+
+  const bool ok = gdk_pixbuf_loader_write(loader, data, size, NULL) == TRUE;
+
+  GdkPixbuf* pixbuf = NULL;
+  if (gdk_pixbuf_loader_close(loader, NULL) == TRUE && ok == true) {
+    pixbuf = gdk_pixbuf_loader_get_pixbuf(loader);
+    if (pixbuf != NULL) {
+      g_object_ref(pixbuf);
     }
+  }
+  g_object_unref(loader);
+
+  return pixbuf;
+}
 
-    GdkPixbuf* pixbuf = gdk_pixbuf_new_from_stream(is, NULL, NULL);
-    if (pixbuf == NULL) {
-      archive_read_close(a);
-      archive_read_free(a);
-      g_object_unref(mis);
-      return NULL;
+static bool
+get_thumbnail_size(cb_document_t* cb_document, const cb_document_page_meta_t* meta,
+    unsigned int level, unsigned int* size, unsigned int* thumbnail_level)
+{
+  int width = 0;
+  int height = 0;
+  if (level == 0 || cb_document_get_page_size(cb_document, meta, &width, &height) == false) {
+    return false;
+  }
+
+  /* pick the smallest rendition that still has at least the needed size */
+  const unsigned int long_edge = MAX(width, height);
+  if ((long_edge >> level) <= CB_THUMBNAIL_SMALL_SIZE) {
+    *size = CB_THUMBNAIL_SMALL_SIZE;
+  } else if ((long_edge >> level) <= CB_THUMBNAIL_LARGE_SIZE) {
+    *size = CB_THUMBNAIL_LARGE_SIZE;
+  } else {
+    return false;
+  }
+
+  /* renditions are decoded at the smallest scale level that keeps that size,
+   * so that they need no further resampling */
+  *thumbnail_level = 0;
+  while (*thumbnail_level < CB_MAX_SCALE_LEVEL && (long_edge >> (*thumbnail_level + 1)) >= *size) {
+    (*thumbnail_level)++;
+  }
+
+  /* not worth storing if it is not smaller than the image */
+  return *thumbnail_level > 0;
+}
+
+static cairo_surface_t*
+load_surface_from_thumbnails(cb_document_t* cb_document, const cb_document_page_meta_t* meta,
+    unsigned int size, unsigned int thumbnail_level)
+{
+  size_t length = 0;
+  void* data = cb_thumbnails_read(cb_document->thumbnails, meta->file, meta->entry, size,
+      &length);
+  if (data != NULL) {
+    cairo_surface_t* surface = load_surface_from_data(cb_document, data, length, 0, false);
+    g_free(data);
+    if (surface != NULL) {
+      return surface;
     }
+  }
 
-    archive_read_close(a);
-    archive_read_free(a);
-    g_object_unref(mis);
-    return pixbuf;
+  /* create the rendition from the archive; the page is read and decoded only
+   * once, by the same decoders as any other page, and stored in the
+   * background */
+  cairo_surface_t* surface = load_surface_from_archive(cb_document, meta, thumbnail_level);
+  if (surface != NULL) {
+    cb_thumbnails_store(cb_document->thumbnails, meta->file, meta->entry, size, surface);
   }
 
-  archive_read_close(a);
-  archive_read_free(a);
-  return NULL;
+  return surface;
 }
 
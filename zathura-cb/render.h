@@ -0,0 +1,25 @@
+/* See LICENSE file for license and copyright information */
+
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <cairo.h>
+
+#include <girara/macros.h>
+
+#include "plugin.h"
+#include "internal.h"
+
+/**
+ * Reads and decodes the image of a page. This does not use the page cache and
+ * may be called from any thread.
+ *
+ * @param cb_document The document
+ * @param meta Meta-data of the page
+ * @param level Scale level; the image is decoded at 1/2^level of its size
+ * @return A new image surface or NULL if an error occurred
+ */
+GIRARA_HIDDEN cairo_surface_t* cb_page_load_surface(cb_document_t* cb_document,
+    const cb_document_page_meta_t* meta, unsigned int level);
+
+#endif // RENDER_H
@@ -0,0 +1,394 @@
+/* See LICENSE file for license and copyright information */
+
+#include <glib.h>
+#include <math.h>
+#include <stdbool.h>
+
+#include "scale.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define CB_SCALE_X86 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#define CB_SCALE_NEON 1
+#include <arm_neon.h>
+#endif
+
+/* weights are fixed point numbers with this many fractional bits; the
+ * weights of a destination pixel add up to exactly 1 */
+#define SCALE_SHIFT 14
+#define SCALE_ONE (1 << SCALE_SHIFT)
+#define SCALE_HALF (1 << (SCALE_SHIFT - 1))
+
+/** Source pixels contributing to each destination pixel along one axis
+ */
+typedef struct scale_filter_s {
+  unsigned int* start; /**< First source pixel of each destination pixel */
+  unsigned int* count; /**< Number of source pixels of each destination pixel */
+  int16_t* weights; /**< taps weights per destination pixel */
+  unsigned int taps; /**< Maximum number of source pixels per destination pixel */
+} scale_filter_t;
+
+typedef void (*scale_row_function_t)(const uint32_t* src, uint32_t* dst,
+    const scale_filter_t* filter, unsigned int width);
+typedef void (*blend_rows_function_t)(const uint8_t* const* rows, const int16_t* weights,
+    unsigned int count, uint8_t* dst, size_t bytes);
+
+static void
+filter_clear(scale_filter_t* filter)
+{
+  g_free(filter->start);
+  g_free(filter->count);
+  g_free(filter->weights);
+}
+
+static bool
+filter_init(scale_filter_t* filter, unsigned int src_size, unsigned int dst_size)
+{
+  const double ratio = (double) src_size / dst_size;
+
+  /* an interval of length ratio overlaps at most ceil(ratio) + 1 pixels */
+  filter->taps = (unsigned int) ceil(ratio) + 1;
+  filter->start = g_try_new(unsigned int, dst_size);
+  filter->count = g_try_new(unsigned int, dst_size);
+  filter->weights = g_try_new0(int16_t, (size_t) dst_size * filter->taps);
+  if (filter->start == NULL || filter->count == NULL || filter->weights == NULL) {
+    filter_clear(filter);
+    return false;
+  }
+
+  for (unsigned int i = 0; i < dst_size; i++) {
+    const double x0 = i * ratio;
+    const double x1 = MIN((i + 1) * ratio, src_size);
+    const unsigned int start = MIN((unsigned int) x0, src_size - 1);
+    const unsigned int end = CLAMP((unsigned int) ceil(x1), start + 1, src_size);
+
+    /* each source pixel is weighted by the part of it that is covered */
+    int16_t* weights = filter->weights + (size_t) i * filter->taps;
+    int sum = 0;
+    unsigned int largest = 0;
+    for (unsigned int j = start; j < end; j++) {
+      const double coverage = MIN(x1, j + 1) - MAX(x0, j);
+      weights[j - start] = (int16_t) lround(MAX(coverage, 0) / ratio * SCALE_ONE);
+      sum += weights[j - start];
+      if (weights[j - start] > weights[largest]) {
+        largest = j - start;
+      }
+    }
+
+    /* make the weights add up to exactly 1 so that flat areas keep their
+     * color */
+    weights[largest] += SCALE_ONE - sum;
+
+    filter->start[i] = start;
+    filter->count[i] = end - start;
+  }
+
+  return true;
+}
+
+static inline uint32_t
+round_channel(uint32_t sum)
+{
+  return MIN((sum + SCALE_HALF) >> SCALE_SHIFT, 255);
+}
+
+static void
+scale_row_scalar(const uint32_t* src, uint32_t* dst, const scale_filter_t* filter,
+    unsigned int width)
+{
+  for (unsigned int i = 0; i < width; i++) {
+    const uint32_t* pixels = src + filter->start[i];
+    const int16_t* weights = filter->weights + (size_t) i * filter->taps;
+
+    uint32_t sum[4] = { 0, 0, 0, 0 };
+    for (unsigned int k = 0; k < filter->count[i]; k++) {
+      for (unsigned int c = 0; c < 4; c++) {
+        sum[c] += ((pixels[k] >> (c * 8)) & 0xff) * (uint32_t) weights[k];
+      }
+    }
+
+    dst[i] = round_channel(sum[0]) | (round_channel(sum[1]) << 8)
+      | (round_channel(sum[2]) << 16) | (round_channel(sum[3]) << 24);
+  }
+}
+
+static void
+blend_bytes_scalar(const uint8_t* const* rows, const int16_t* weights, unsigned int count,
+    uint8_t* dst, size_t from, size_t bytes)
+{
+  for (size_t j = from; j < bytes; j++) {
+    uint32_t sum = 0;
+    for (unsigned int k = 0; k < count; k++) {
+      sum += rows[k][j] * (uint32_t) weights[k];
+    }
+    dst[j] = round_channel(sum);
+  }
+}
+
+static void
+blend_rows_scalar(const uint8_t* const* rows, const int16_t* weights, unsigned int count,
+    uint8_t* dst, size_t bytes)
+{
+  blend_bytes_scalar(rows, weights, count, dst, 0, bytes);
+}
+
+#ifdef CB_SCALE_X86
+/* Both kernels use pmaddwd on interleaved pairs of 16 bit values: with the
+ * weights of two pixels (or rows) in every 32 bit lane, one instruction
+ * multiplies and adds both. The weights are below 2^15, so the signed
+ * multiplication is exact. */
+
+static inline int
+weight_pair(const int16_t* weights, unsigned int k, bool pair)
+{
+  return (int) (((uint32_t) (pair == true ? (uint16_t) weights[k + 1] : 0) << 16)
+      | (uint16_t) weights[k]);
+}
+
+__attribute__((target("sse2"))) static void
+scale_row_sse2(const uint32_t* src, uint32_t* dst, const scale_filter_t* filter,
+    unsigned int width)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i half = _mm_set1_epi32(SCALE_HALF);
+
+  for (unsigned int i = 0; i < width; i++) {
+    const uint32_t* pixels = src + filter->start[i];
+    const int16_t* weights = filter->weights + (size_t) i * filter->taps;
+    const unsigned int count = filter->count[i];
+
+    /* two source pixels per step, their channels interleaved */
+    __m128i sum = zero;
+    unsigned int k = 0;
+    for (; k + 2 <= count; k += 2) {
+      const __m128i p = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*) (pixels + k)), zero);
+      const __m128i pairs = _mm_unpacklo_epi16(p, _mm_srli_si128(p, 8));
+      sum = _mm_add_epi32(sum, _mm_madd_epi16(pairs, _mm_set1_epi32(weight_pair(weights, k, true))));
+    }
+    if (k < count) {
+      const __m128i p = _mm_unpacklo_epi8(_mm_cvtsi32_si128((int) pixels[k]), zero);
+      const __m128i pairs = _mm_unpacklo_epi16(p, zero);
+      sum = _mm_add_epi32(sum, _mm_madd_epi16(pairs, _mm_set1_epi32(weight_pair(weights, k, false))));
+    }
+
+    sum = _mm_srai_epi32(_mm_add_epi32(sum, half), SCALE_SHIFT);
+    sum = _mm_packs_epi32(sum, sum);
+    dst[i] = (uint32_t) _mm_cvtsi128_si32(_mm_packus_epi16(sum, sum));
+  }
+}
+
+__attribute__((target("sse2"))) static void
+blend_rows_sse2(const uint8_t* const* rows, const int16_t* weights, unsigned int count,
+    uint8_t* dst, size_t bytes)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i half = _mm_set1_epi32(SCALE_HALF);
+
+  /* 16 bytes per step, two rows at a time */
+  size_t j = 0;
+  for (; j + 16 <= bytes; j += 16) {
+    __m128i sum0 = zero;
+    __m128i sum1 = zero;
+    __m128i sum2 = zero;
+    __m128i sum3 = zero;
+    for (unsigned int k = 0; k < count; k += 2) {
+      const bool pair = k + 1 < count;
+      const __m128i a = _mm_loadu_si128((const __m128i*) (rows[k] + j));
+      const __m128i b = pair == true ? _mm_loadu_si128((const __m128i*) (rows[k + 1] + j)) : zero;
+      const __m128i w = _mm_set1_epi32(weight_pair(weights, k, pair));
+
+      const __m128i alo = _mm_unpacklo_epi8(a, zero);
+      const __m128i ahi = _mm_unpackhi_epi8(a, zero);
+      const __m128i blo = _mm_unpacklo_epi8(b, zero);
+      const __m128i bhi = _mm_unpackhi_epi8(b, zero);
+      sum0 = _mm_add_epi32(sum0, _mm_madd_epi16(_mm_unpacklo_epi16(alo, blo), w));
+      sum1 = _mm_add_epi32(sum1, _mm_madd_epi16(_mm_unpackhi_epi16(alo, blo), w));
+      sum2 = _mm_add_epi32(sum2, _mm_madd_epi16(_mm_unpacklo_epi16(ahi, bhi), w));
+      sum3 = _mm_add_epi32(sum3, _mm_madd_epi16(_mm_unpackhi_epi16(ahi, bhi), w));
+    }
+
+    sum0 = _mm_srai_epi32(_mm_add_epi32(sum0, half), SCALE_SHIFT);
+    sum1 = _mm_srai_epi32(_mm_add_epi32(sum1, half), SCALE_SHIFT);
+    sum2 = _mm_srai_epi32(_mm_add_epi32(sum2, half), SCALE_SHIFT);
+    sum3 = _mm_srai_epi32(_mm_add_epi32(sum3, half), SCALE_SHIFT);
+    _mm_storeu_si128((__m128i*) (dst + j),
+        _mm_packus_epi16(_mm_packs_epi32(sum0, sum1), _mm_packs_epi32(sum2, sum3)));
+  }
+
+  blend_bytes_scalar(rows, weights, count, dst, j, bytes);
+}
+
+__attribute__((target("avx2"))) static void
+blend_rows_avx2(const uint8_t* const* rows, const int16_t* weights, unsigned int count,
+    uint8_t* dst, size_t bytes)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i half = _mm256_set1_epi32(SCALE_HALF);
+
+  /* 32 bytes per step; unpack and pack work per lane, so the byte order is
+   * preserved */
+  size_t j = 0;
+  for (; j + 32 <= bytes; j += 32) {
+    __m256i sum0 = zero;
+    __m256i sum1 = zero;
+    __m256i sum2 = zero;
+    __m256i sum3 = zero;
+    for (unsigned int k = 0; k < count; k += 2) {
+      const bool pair = k + 1 < count;
+      const __m256i a = _mm256_loadu_si256((const __m256i*) (rows[k] + j));
+      const __m256i b = pair == true ? _mm256_loadu_si256((const __m256i*) (rows[k + 1] + j)) : zero;
+      const __m256i w = _mm256_set1_epi32(weight_pair(weights, k, pair));
+
+      const __m256i alo = _mm256_unpacklo_epi8(a, zero);
+      const __m256i ahi = _mm256_unpackhi_epi8(a, zero);
+      const __m256i blo = _mm256_unpacklo_epi8(b, zero);
+      const __m256i bhi = _mm256_unpackhi_epi8(b, zero);
+      sum0 = _mm256_add_epi32(sum0, _mm256_madd_epi16(_mm256_unpacklo_epi16(alo, blo), w));
+      sum1 = _mm256_add_epi32(sum1, _mm256_madd_epi16(_mm256_unpackhi_epi16(alo, blo), w));
+      sum2 = _mm256_add_epi32(sum2, _mm256_madd_epi16(_mm256_unpacklo_epi16(ahi, bhi), w));
+      sum3 = _mm256_add_epi32(sum3, _mm256_madd_epi16(_mm256_unpackhi_epi16(ahi, bhi), w));
+    }
+
+    sum0 = _mm256_srai_epi32(_mm256_add_epi32(sum0, half), SCALE_SHIFT);
+    sum1 = _mm256_srai_epi32(_mm256_add_epi32(sum1, half), SCALE_SHIFT);
+    sum2 = _mm256_srai_epi32(_mm256_add_epi32(sum2, half), SCALE_SHIFT);
+    sum3 = _mm256_srai_epi32(_mm256_add_epi32(sum3, half), SCALE_SHIFT);
+    _mm256_storeu_si256((__m256i*) (dst + j), _mm256_packus_epi16(
+          _mm256_packs_epi32(sum0, sum1), _mm256_packs_epi32(sum2, sum3)));
+  }
+
+  blend_bytes_scalar(rows, weights, count, dst, j, bytes);
+}
+#endif
+
+#ifdef CB_SCALE_NEON
+static void
+blend_rows_neon(const uint8_t* const* rows, const int16_t* weights, unsigned int count,
+    uint8_t* dst, size_t bytes)
+{
+  size_t j = 0;
+  for (; j + 8 <= bytes; j += 8) {
+    uint32x4_t sum_low = vdupq_n_u32(0);
+    uint32x4_t sum_high = vdupq_n_u32(0);
+    for (unsigned int k = 0; k < count; k++) {
+      const uint16x8_t v = vmovl_u8(vld1_u8(rows[k] + j));
+      sum_low = vmlal_n_u16(sum_low, vget_low_u16(v), (uint16_t) weights[k]);
+      sum_high = vmlal_n_u16(sum_high, vget_high_u16(v), (uint16_t) weights[k]);
+    }
+
+    const uint16x8_t rounded = vcombine_u16(vrshrn_n_u32(sum_low, SCALE_SHIFT),
+        vrshrn_n_u32(sum_high, SCALE_SHIFT));
+    vst1_u8(dst + j, vqmovn_u16(rounded));
+  }
+
+  blend_bytes_scalar(rows, weights, count, dst, j, bytes);
+}
+#endif
+
+typedef struct scale_functions_s {
+  scale_row_function_t scale_row;
+  blend_rows_function_t blend_rows;
+} scale_functions_t;
+
+static const scale_functions_t*
+get_scale_functions(void)
+{
+  static scale_functions_t functions;
+  static gsize initialized = 0;
+
+  if (g_once_init_enter(&initialized)) {
+    functions.scale_row = scale_row_scalar;
+    functions.blend_rows = blend_rows_scalar;
+
+#if defined(CB_SCALE_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) {
+      functions.scale_row = scale_row_sse2;
+      functions.blend_rows = blend_rows_sse2;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+      functions.blend_rows = blend_rows_avx2;
+    }
+#elif defined(CB_SCALE_NEON)
+    functions.blend_rows = blend_rows_neon;
+#endif
+
+    g_once_init_leave(&initialized, 1);
+  }
+
+  return &functions;
+}
+
+cairo_surface_t*
+cb_scale_surface(cairo_surface_t* surface, int width, int height)
+{
+  if (surface == NULL || cairo_surface_get_type(surface) != CAIRO_SURFACE_TYPE_IMAGE) {
+    return NULL;
+  }
+
+  const cairo_format_t format = cairo_image_surface_get_format(surface);
+  const int src_width = cairo_image_surface_get_width(surface);
+  const int src_height = cairo_image_surface_get_height(surface);
+  if ((format != CAIRO_FORMAT_ARGB32 && format != CAIRO_FORMAT_RGB24)
+      || width <= 0 || height <= 0 || width > src_width || height > src_height) {
+    return NULL;
+  }
+
+  scale_filter_t filter_x;
+  scale_filter_t filter_y;
+  if (filter_init(&filter_x, src_width, width) == false) {
+    return NULL;
+  }
+  if (filter_init(&filter_y, src_height, height) == false) {
+    filter_clear(&filter_x);
+    return NULL;
+  }
+
+  /* The rows are first scaled horizontally into a ring of filter_y.taps
+   * rows, then blended vertically. The source rows of consecutive
+   * destination rows only move forward and never span more than taps rows,
+   * so every source row is scaled once and stays in the ring as long as it is
+   * needed. */
+  uint32_t* ring = g_try_malloc((size_t) filter_y.taps * width * sizeof(uint32_t));
+  const uint8_t** rows = g_try_new(const uint8_t*, filter_y.taps);
+  cairo_surface_t* result = cairo_image_surface_create(format, width, height);
+  if (ring == NULL || rows == NULL || cairo_surface_status(result) != CAIRO_STATUS_SUCCESS) {
+    cairo_surface_destroy(result);
+    result = NULL;
+    goto out;
+  }
+
+  cairo_surface_flush(surface);
+  const unsigned char* src = cairo_image_surface_get_data(surface);
+  const int src_stride = cairo_image_surface_get_stride(surface);
+  unsigned char* dst = cairo_image_surface_get_data(result);
+  const int dst_stride = cairo_image_surface_get_stride(result);
+
+  const scale_functions_t* functions = get_scale_functions();
+  unsigned int next_row = 0;
+  for (int y = 0; y < height; y++) {
+    const unsigned int start = filter_y.start[y];
+    const unsigned int count = filter_y.count[y];
+
+    for (next_row = MAX(next_row, start); next_row < start + count; next_row++) {
+      functions->scale_row((const uint32_t*) (src + (size_t) next_row * src_stride),
+          ring + (size_t) (next_row % filter_y.taps) * width, &filter_x, width);
+    }
+
+    for (unsigned int k = 0; k < count; k++) {
+      rows[k] = (const uint8_t*) (ring + (size_t) ((start + k) % filter_y.taps) * width);
+    }
+    functions->blend_rows(rows, filter_y.weights + (size_t) y * filter_y.taps, count,
+        dst + (size_t) y * dst_stride, (size_t) width * sizeof(uint32_t));
+  }
+  cairo_surface_mark_dirty(result);
+
+out:
+  g_free(rows);
+  g_free(ring);
+  filter_clear(&filter_y);
+  filter_clear(&filter_x);
+
+  return result;
+}
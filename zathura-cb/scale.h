@@ -0,0 +1,25 @@
+/* See LICENSE file for license and copyright information */
+
+#ifndef SCALE_H
+#define SCALE_H
+
+#include <cairo.h>
+
+#include <girara/macros.h>
+
+/**
+ * Reduces an image surface to the given size. Every destination pixel is the
+ * area-weighted average of the source pixels it covers (a box filter), which
+ * gives better quality than cairo's filters for large reductions and is
+ * faster than CAIRO_FILTER_GOOD. The image is scaled independently in both
+ * directions, so the aspect ratio may change.
+ *
+ * @param surface Image surface in CAIRO_FORMAT_ARGB32 or CAIRO_FORMAT_RGB24
+ * @param width Width of the result, at most the width of the surface
+ * @param height Height of the result, at most the height of the surface
+ * @return A new image surface of the same format or NULL if the surface
+ *   cannot be scaled or an error occurred
+ */
+GIRARA_HIDDEN cairo_surface_t* cb_scale_surface(cairo_surface_t* surface, int width, int height);
+
+#endif // SCALE_H
@@ -0,0 +1,239 @@
+/* See LICENSE file for license and copyright information */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <archive.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "source.h"
+#include "internal.h"
+
+struct cb_source_s {
+  int fd; /**< Archive file */
+  int64_t length; /**< Size of the file */
+  int64_t mtime; /**< Modification time of the file in nanoseconds */
+  unsigned char* data; /**< Mapping of the file, NULL if not mapped */
+};
+
+/** State of a libarchive handle reading through pread
+ */
+typedef struct cb_source_stream_s {
+  cb_source_t* source; /**< The source */
+  int64_t base; /**< Offset of the stream in the file */
+  int64_t position; /**< Current position relative to base */
+  unsigned char buffer[LIBARCHIVE_BUFFER_SIZE]; /**< Data handed to libarchive */
+} cb_source_stream_t;
+
+cb_source_t*
+cb_source_new(const char* path, bool map)
+{
+  if (path == NULL) {
+    return NULL;
+  }
+
+  const int fd = g_open(path, O_RDONLY | O_CLOEXEC, 0);
+  if (fd == -1) {
+    return NULL;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || S_ISREG(st.st_mode) == 0) {
+    close(fd);
+    return NULL;
+  }
+
+  cb_source_t* source = g_malloc0(sizeof(cb_source_t));
+  source->fd = fd;
+  source->length = st.st_size;
+  source->mtime = (int64_t) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+
+  if (map == true && st.st_size > 0 && (uint64_t) st.st_size <= SIZE_MAX) {
+    void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED) {
+      source->data = data;
+    }
+  }
+
+  return source;
+}
+
+void
+cb_source_free(cb_source_t* source)
+{
+  if (source == NULL) {
+    return;
+  }
+
+  if (source->data != NULL) {
+    munmap(source->data, source->length);
+  }
+  close(source->fd);
+  g_free(source);
+}
+
+void
+cb_source_advise(cb_source_t* source, cb_source_access_t access)
+{
+  if (source == NULL) {
+    return;
+  }
+
+  const bool sequential = access == CB_SOURCE_ACCESS_SEQUENTIAL;
+  if (source->data != NULL) {
+    madvise(source->data, source->length, sequential == true ? MADV_SEQUENTIAL : MADV_RANDOM);
+  } else {
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(source->fd, 0, 0, sequential == true ? POSIX_FADV_SEQUENTIAL : POSIX_FADV_RANDOM);
+#endif
+  }
+}
+
+int64_t
+cb_source_get_size(cb_source_t* source)
+{
+  return source != NULL ? source->length : -1;
+}
+
+int64_t
+cb_source_get_mtime(cb_source_t* source)
+{
+  return source != NULL ? source->mtime : -1;
+}
+
+bool
+cb_source_read(cb_source_t* source, void* buffer, size_t size, int64_t offset)
+{
+  if (source == NULL || buffer == NULL || offset < 0 || offset > source->length
+      || size > (uint64_t) (source->length - offset)) {
+    return false;
+  }
+
+  if (source->data != NULL) {
+    memcpy(buffer, source->data + offset, size);
+    return true;
+  }
+
+  unsigned char* data = buffer;
+  while (size > 0) {
+    const ssize_t r = pread(source->fd, data, size, offset);
+    if (r <= 0) {
+      return false;
+    }
+    data += r;
+    size -= r;
+    offset += r;
+  }
+
+  return true;
+}
+
+static la_ssize_t
+stream_read(struct archive* UNUSED(a), void* data, const void** buffer)
+{
+  cb_source_stream_t* stream = data;
+
+  const ssize_t r = pread(stream->source->fd, stream->buffer, sizeof(stream->buffer),
+      stream->base + stream->position);
+  if (r < 0) {
+    return -1;
+  }
+
+  stream->position += r;
+  *buffer = stream->buffer;
+  return r;
+}
+
+static la_int64_t
+stream_skip(struct archive* UNUSED(a), void* data, la_int64_t request)
+{
+  cb_source_stream_t* stream = data;
+
+  const int64_t remaining = stream->source->length - stream->base - stream->position;
+  const int64_t skipped = CLAMP(request, 0, MAX(remaining, 0));
+  stream->position += skipped;
+
+  return skipped;
+}
+
+static la_int64_t
+stream_seek(struct archive* UNUSED(a), void* data, la_int64_t offset, int whence)
+{
+  cb_source_stream_t* stream = data;
+
+  int64_t position = 0;
+  switch (whence) {
+    case SEEK_SET:
+      position = offset;
+      break;
+    case SEEK_CUR:
+      position = stream->position + offset;
+      break;
+    case SEEK_END:
+      position = stream->source->length - stream->base + offset;
+      break;
+    default:
+      return ARCHIVE_FATAL;
+  }
+
+  if (position < 0) {
+    return ARCHIVE_FATAL;
+  }
+
+  stream->position = position;
+  return position;
+}
+
+static int
+stream_close(struct archive* UNUSED(a), void* data)
+{
+  g_free(data);
+  return ARCHIVE_OK;
+}
+
+struct archive*
+cb_source_open_archive(cb_source_t* source, int64_t offset, bool tar_only)
+{
+  if (source == NULL || offset < 0 || offset > source->length) {
+    return NULL;
+  }
+
+  struct archive* a = archive_read_new();
+  if (a == NULL) {
+    return NULL;
+  }
+
+  if (tar_only == true) {
+    archive_read_support_format_tar(a);
+  } else {
+    archive_read_support_filter_all(a);
+    archive_read_support_format_all(a);
+  }
+
+  int r = ARCHIVE_OK;
+  if (source->data != NULL) {
+    /* libarchive reads from the mapping without copying and seeks in it */
+    r = archive_read_open_memory(a, source->data + offset, source->length - offset);
+  } else {
+    cb_source_stream_t* stream = g_malloc0(sizeof(cb_source_stream_t));
+    stream->source = source;
+    stream->base = offset;
+
+    archive_read_set_read_callback(a, stream_read);
+    archive_read_set_skip_callback(a, stream_skip);
+    archive_read_set_seek_callback(a, stream_seek);
+    archive_read_set_close_callback(a, stream_close);
+    archive_read_set_callback_data(a, stream);
+    r = archive_read_open1(a);
+  }
+
+  if (r != ARCHIVE_OK) {
+    archive_read_free(a);
+    return NULL;
+  }
+
+  return a;
+}
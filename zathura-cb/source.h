@@ -0,0 +1,91 @@
+/* See LICENSE file for license and copyright information */
+
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <girara/macros.h>
+
+struct archive;
+
+typedef struct cb_source_s cb_source_t;
+
+/** Expected access pattern of an archive
+ */
+typedef enum cb_source_access_e {
+  CB_SOURCE_ACCESS_SEQUENTIAL, /**< The archive is read front to back */
+  CB_SOURCE_ACCESS_RANDOM /**< Entries are read in arbitrary order */
+} cb_source_access_t;
+
+/**
+ * Opens an archive file. The file is memory-mapped once if possible;
+ * otherwise it is read with pread through a single file descriptor. The
+ * source may be shared by any number of threads.
+ *
+ * @param path Path of the archive
+ * @param map false to never map the file
+ * @return The source or NULL if the file could not be opened
+ */
+GIRARA_HIDDEN cb_source_t* cb_source_new(const char* path, bool map);
+
+/**
+ * Unmaps and closes the archive file. All archives opened from the source
+ * must have been freed before.
+ *
+ * @param source The source
+ */
+GIRARA_HIDDEN void cb_source_free(cb_source_t* source);
+
+/**
+ * Tells the kernel how the archive is going to be read
+ *
+ * @param source The source
+ * @param access Expected access pattern
+ */
+GIRARA_HIDDEN void cb_source_advise(cb_source_t* source, cb_source_access_t access);
+
+/**
+ * Returns the size of the archive file
+ *
+ * @param source The source
+ * @return The size in bytes
+ */
+GIRARA_HIDDEN int64_t cb_source_get_size(cb_source_t* source);
+
+/**
+ * Returns the modification time of the archive file at the time it was opened
+ *
+ * @param source The source
+ * @return The modification time in nanoseconds since the epoch
+ */
+GIRARA_HIDDEN int64_t cb_source_get_mtime(cb_source_t* source);
+
+/**
+ * Reads a range of the archive file
+ *
+ * @param source The source
+ * @param buffer Buffer of at least size bytes
+ * @param size Number of bytes to read
+ * @param offset Offset in the file
+ * @return true if the whole range was read
+ */
+GIRARA_HIDDEN bool cb_source_read(cb_source_t* source, void* buffer, size_t size,
+    int64_t offset);
+
+/**
+ * Opens a libarchive handle reading from the source
+ *
+ * @param source The source
+ * @param offset Offset in the file where the archive stream starts
+ * @param tar_only true to only enable the tar format without filters, e.g.
+ *   when starting at the header of an entry of an uncompressed tar archive
+ * @return The archive, to be freed with archive_read_free, or NULL if an
+ *   error occurred
+ */
+GIRARA_HIDDEN struct archive* cb_source_open_archive(cb_source_t* source, int64_t offset,
+    bool tar_only);
+
+#endif // SOURCE_H
@@ -0,0 +1,295 @@
+/* See LICENSE file for license and copyright information */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <archive.h>
+#include <archive_entry.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "spool.h"
+
+/** Location of an extracted entry in the spool
+ */
+typedef struct cb_spool_extent_s {
+  int64_t offset; /**< Offset of the data */
+  size_t size; /**< Size of the data */
+} cb_spool_extent_t;
+
+struct cb_spool_s {
+  cb_source_t* source; /**< The archive file */
+  GHashTable* wanted; /**< Entry positions (+ 1) of the pages */
+  size_t memory_limit; /**< Maximum size of memory */
+  GThread* thread; /**< Extraction thread */
+  gint cancel; /**< Set to stop the extraction thread */
+
+  GMutex lock; /**< Protects the members below */
+  GCond extracted; /**< Signalled when an entry has been extracted */
+  GHashTable* extents; /**< Entry positions (+ 1) to cb_spool_extent_t */
+  unsigned char* memory; /**< Spooled data while it fits into memory_limit */
+  size_t memory_size; /**< Bytes used in memory */
+  size_t memory_capacity; /**< Bytes allocated for memory */
+  int fd; /**< Unlinked spool file, -1 while the data is in memory */
+  int64_t size; /**< Total number of bytes spooled */
+  bool finished; /**< Set when the extraction thread is done */
+};
+
+static int
+open_spool_file(void)
+{
+  char* directory = g_build_filename(g_get_user_cache_dir(), "zathura-cb", NULL);
+  if (g_mkdir_with_parents(directory, 0700) != 0) {
+    g_free(directory);
+    return -1;
+  }
+
+  char* path = g_build_filename(directory, "spool-XXXXXX", NULL);
+  g_free(directory);
+
+  /* the file is removed right away and disappears once it is closed */
+  const int fd = g_mkstemp(path);
+  if (fd != -1) {
+    g_unlink(path);
+  }
+  g_free(path);
+
+  return fd;
+}
+
+static bool
+write_all(int fd, const void* data, size_t size, int64_t offset)
+{
+  const unsigned char* buffer = data;
+  while (size > 0) {
+    const ssize_t r = pwrite(fd, buffer, size, offset);
+    if (r <= 0) {
+      return false;
+    }
+    buffer += r;
+    size -= r;
+    offset += r;
+  }
+
+  return true;
+}
+
+/* must be called with the lock held */
+static bool
+spool_append(cb_spool_t* spool, const void* data, size_t size)
+{
+  if (spool->fd == -1 && spool->memory_size + size > spool->memory_limit) {
+    /* move everything to a file */
+    const int fd = open_spool_file();
+    if (fd == -1) {
+      return false;
+    } else if (write_all(fd, spool->memory, spool->memory_size, 0) == false) {
+      close(fd);
+      return false;
+    }
+    spool->fd = fd;
+
+    g_free(spool->memory);
+    spool->memory = NULL;
+    spool->memory_size = 0;
+    spool->memory_capacity = 0;
+  }
+
+  if (spool->fd != -1) {
+    if (write_all(spool->fd, data, size, spool->size) == false) {
+      return false;
+    }
+  } else {
+    if (spool->memory_size + size > spool->memory_capacity) {
+      const size_t capacity = MAX(spool->memory_capacity * 2, spool->memory_size + size);
+      unsigned char* memory = g_try_realloc(spool->memory, MIN(capacity, spool->memory_limit));
+      if (memory == NULL) {
+        return false;
+      }
+      spool->memory = memory;
+      spool->memory_capacity = MIN(capacity, spool->memory_limit);
+    }
+
+    memcpy(spool->memory + spool->memory_size, data, size);
+    spool->memory_size += size;
+  }
+
+  spool->size += size;
+  return true;
+}
+
+static bool
+extract_entry(cb_spool_t* spool, struct archive* a, unsigned int entry_index)
+{
+  g_mutex_lock(&spool->lock);
+  const int64_t offset = spool->size;
+  g_mutex_unlock(&spool->lock);
+
+  int r = 0;
+  size_t size = 0;
+  const void* buf = NULL;
+  __LA_INT64_T block_offset = 0;
+  while ((r = archive_read_data_block(a, &buf, &size, &block_offset)) != ARCHIVE_EOF) {
+    if (r < ARCHIVE_WARN || g_atomic_int_get(&spool->cancel) != 0) {
+      return false;
+    }
+
+    if (size == 0 || buf == NULL) {
+      continue;
+    }
+
+    g_mutex_lock(&spool->lock);
+    const bool ok = spool_append(spool, buf, size);
+    g_mutex_unlock(&spool->lock);
+    if (ok == false) {
+      return false;
+    }
+  }
+
+  cb_spool_extent_t* extent = g_malloc0(sizeof(cb_spool_extent_t));
+
+  g_mutex_lock(&spool->lock);
+  extent->offset = offset;
+  extent->size = spool->size - offset;
+  g_hash_table_insert(spool->extents, GUINT_TO_POINTER(entry_index + 1), extent);
+  g_cond_broadcast(&spool->extracted);
+  g_mutex_unlock(&spool->lock);
+
+  return true;
+}
+
+static gpointer
+extract_archive(gpointer data)
+{
+  cb_spool_t* spool = data;
+
+  struct archive* a = cb_source_open_archive(spool->source, 0, false);
+  if (a != NULL) {
+    struct archive_entry* entry = NULL;
+    unsigned int remaining = g_hash_table_size(spool->wanted);
+    for (unsigned int entry_index = 0; remaining > 0; entry_index++) {
+      if (archive_read_next_header(a, &entry) < ARCHIVE_WARN
+          || g_atomic_int_get(&spool->cancel) != 0) {
+        break;
+      }
+
+      if (g_hash_table_contains(spool->wanted, GUINT_TO_POINTER(entry_index + 1)) == FALSE) {
+        continue;
+      }
+
+      if (extract_entry(spool, a, entry_index) == false) {
+        break;
+      }
+      remaining--;
+    }
+
+    archive_read_free(a);
+  }
+
+  /* wake up readers waiting for entries that will never come */
+  g_mutex_lock(&spool->lock);
+  spool->finished = true;
+  g_cond_broadcast(&spool->extracted);
+  g_mutex_unlock(&spool->lock);
+
+  return NULL;
+}
+
+cb_spool_t*
+cb_spool_new(cb_source_t* source, GArray* pages, size_t memory_limit)
+{
+  cb_spool_t* spool = g_malloc0(sizeof(cb_spool_t));
+
+  spool->source = source;
+  spool->memory_limit = memory_limit;
+  spool->fd = -1;
+  g_mutex_init(&spool->lock);
+  g_cond_init(&spool->extracted);
+  spool->extents = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+
+  spool->wanted = g_hash_table_new(g_direct_hash, g_direct_equal);
+  for (guint i = 0; i < pages->len; i++) {
+    const cb_document_page_meta_t* meta = &g_array_index(pages, cb_document_page_meta_t, i);
+    g_hash_table_add(spool->wanted, GUINT_TO_POINTER(meta->entry + 1));
+  }
+
+  spool->thread = g_thread_try_new("cb-spool", extract_archive, spool, NULL);
+  if (spool->thread == NULL) {
+    spool->finished = true;
+  }
+
+  return spool;
+}
+
+void
+cb_spool_free(cb_spool_t* spool)
+{
+  if (spool == NULL) {
+    return;
+  }
+
+  if (spool->thread != NULL) {
+    g_atomic_int_set(&spool->cancel, 1);
+    g_thread_join(spool->thread);
+  }
+
+  if (spool->fd != -1) {
+    close(spool->fd);
+  }
+  g_free(spool->memory);
+  g_hash_table_destroy(spool->extents);
+  g_hash_table_destroy(spool->wanted);
+  g_cond_clear(&spool->extracted);
+  g_mutex_clear(&spool->lock);
+  g_free(spool);
+}
+
+void*
+cb_spool_read_entry(cb_spool_t* spool, const cb_document_page_meta_t* meta, size_t* size)
+{
+  if (spool == NULL || meta == NULL || size == NULL) {
+    return NULL;
+  }
+
+  g_mutex_lock(&spool->lock);
+
+  const cb_spool_extent_t* extent = NULL;
+  while ((extent = g_hash_table_lookup(spool->extents, GUINT_TO_POINTER(meta->entry + 1))) == NULL) {
+    if (spool->finished == true) {
+      g_mutex_unlock(&spool->lock);
+      return NULL;
+    }
+    g_cond_wait(&spool->extracted, &spool->lock);
+  }
+
+  /* extents never change once they are recorded */
+  const int64_t offset = extent->offset;
+  *size = extent->size;
+
+  unsigned char* data = g_try_malloc(MAX(*size, 1));
+  if (data == NULL) {
+    g_mutex_unlock(&spool->lock);
+    return NULL;
+  }
+
+  if (spool->fd == -1) {
+    memcpy(data, spool->memory + offset, *size);
+    g_mutex_unlock(&spool->lock);
+    return data;
+  }
+
+  /* the file is only appended to and stays open until the spool is freed */
+  const int fd = spool->fd;
+  g_mutex_unlock(&spool->lock);
+
+  size_t length = 0;
+  while (length < *size) {
+    const ssize_t r = pread(fd, data + length, *size - length, offset + length);
+    if (r <= 0) {
+      g_free(data);
+      return NULL;
+    }
+    length += r;
+  }
+
+  return data;
+}
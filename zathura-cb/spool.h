@@ -0,0 +1,50 @@
+/* See LICENSE file for license and copyright information */
+
+#ifndef SPOOL_H
+#define SPOOL_H
+
+#include <stddef.h>
+
+#include <girara/macros.h>
+
+#include "plugin.h"
+#include "internal.h"
+#include "source.h"
+
+typedef struct cb_spool_s cb_spool_t;
+
+/**
+ * Starts extracting all pages of a solid archive in the background. Reaching
+ * an entry of a solid archive requires decompressing everything before it,
+ * so the pages are decompressed once, in archive order, into a spool that
+ * stays in memory up to a limit and is moved to a temporary file in the
+ * user's cache directory beyond it.
+ *
+ * @param source The archive file; it must outlive the spool
+ * @param pages Array of cb_document_page_meta_t; it must outlive the spool
+ * @param memory_limit Maximum number of bytes kept in memory
+ * @return The spool
+ */
+GIRARA_HIDDEN cb_spool_t* cb_spool_new(cb_source_t* source, GArray* pages, size_t memory_limit);
+
+/**
+ * Stops the extraction and frees the spool
+ *
+ * @param spool The spool
+ */
+GIRARA_HIDDEN void cb_spool_free(cb_spool_t* spool);
+
+/**
+ * Reads the data of a page from the spool, waiting until the extraction has
+ * reached it
+ *
+ * @param spool The spool
+ * @param meta Meta-data of the page
+ * @param size Set to the size of the data
+ * @return The data, to be freed with g_free, or NULL if the page could not be
+ *   extracted
+ */
+GIRARA_HIDDEN void* cb_spool_read_entry(cb_spool_t* spool, const cb_document_page_meta_t* meta,
+    size_t* size);
+
+#endif // SPOOL_H
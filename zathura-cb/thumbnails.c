@@ -0,0 +1,289 @@
+/* See LICENSE file for license and copyright information */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <gtk/gtk.h>
+#include <glib/gstdio.h>
+
+#include "thumbnails.h"
+
+/* Renditions waiting to be stored hold a reference to their surface; beyond
+ * this many, new ones are dropped and created again on a later visit. */
+#define MAX_PENDING_RENDITIONS 64
+
+struct cb_thumbnails_s {
+  char* fingerprint; /**< Fingerprint of the archive */
+  char* directory; /**< Directory of the renditions */
+  uint64_t max_size; /**< Budget of the directory in bytes, 0 for no limit */
+  GThreadPool* pool; /**< Worker encoding and writing renditions */
+  gint closing; /**< Set when the store is freed, accessed atomically */
+  GMutex lock; /**< Protects the members below */
+  GHashTable* pending; /**< Paths of the renditions queued or being stored */
+  bool created; /**< Set once the directory exists */
+  bool scanned; /**< Set once usage has been determined */
+  uint64_t usage; /**< Bytes taken by the files in the directory */
+};
+
+/** A rendition queued to be stored
+ */
+typedef struct rendition_job_s {
+  char* path; /**< Path of the file */
+  cairo_surface_t* surface; /**< Image of the rendition */
+} rendition_job_t;
+
+static void store_rendition(gpointer data, gpointer user_data);
+
+/** A file of the rendition directory
+ */
+typedef struct rendition_s {
+  char* path; /**< Path of the file */
+  gint64 mtime; /**< Time of the last use */
+  uint64_t size; /**< Size of the file */
+} rendition_t;
+
+cb_thumbnails_t*
+cb_thumbnails_new(const char* fingerprint, size_t max_size)
+{
+  if (fingerprint == NULL) {
+    return NULL;
+  }
+
+  cb_thumbnails_t* thumbnails = g_malloc0(sizeof(cb_thumbnails_t));
+  thumbnails->fingerprint = g_strdup(fingerprint);
+  thumbnails->directory = g_build_filename(g_get_user_cache_dir(), "zathura-cb", "thumbnails", NULL);
+  thumbnails->max_size = max_size;
+  g_mutex_init(&thumbnails->lock);
+  thumbnails->pending = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+  /* a single worker is enough; it only has to keep up with the pages the
+   * reader looks at */
+  thumbnails->pool = g_thread_pool_new(store_rendition, thumbnails, 1, FALSE, NULL);
+  if (thumbnails->pool == NULL) {
+    cb_thumbnails_free(thumbnails);
+    return NULL;
+  }
+
+  return thumbnails;
+}
+
+void
+cb_thumbnails_free(cb_thumbnails_t* thumbnails)
+{
+  if (thumbnails == NULL) {
+    return;
+  }
+
+  /* renditions still queued are dropped without being encoded */
+  g_atomic_int_set(&thumbnails->closing, 1);
+  if (thumbnails->pool != NULL) {
+    g_thread_pool_free(thumbnails->pool, FALSE, TRUE);
+  }
+
+  g_hash_table_destroy(thumbnails->pending);
+  g_mutex_clear(&thumbnails->lock);
+  g_free(thumbnails->fingerprint);
+  g_free(thumbnails->directory);
+  g_free(thumbnails);
+}
+
+static char*
+get_rendition_path(cb_thumbnails_t* thumbnails, const char* file, unsigned int entry,
+    unsigned int size)
+{
+  char* key = g_strdup_printf("%s\n%u\n%s\n%u", thumbnails->fingerprint, entry, file, size);
+  char* name = g_compute_checksum_for_string(G_CHECKSUM_SHA256, key, -1);
+  char* path = g_build_filename(thumbnails->directory, name, NULL);
+  g_free(name);
+  g_free(key);
+
+  return path;
+}
+
+static int
+compare_renditions(const void* data1, const void* data2)
+{
+  const rendition_t* rendition1 = data1;
+  const rendition_t* rendition2 = data2;
+
+  return (rendition1->mtime > rendition2->mtime) - (rendition1->mtime < rendition2->mtime);
+}
+
+static void
+prune(cb_thumbnails_t* thumbnails)
+{
+  GDir* dir = g_dir_open(thumbnails->directory, 0, NULL);
+  if (dir == NULL) {
+    thumbnails->usage = 0;
+    return;
+  }
+
+  /* renditions of all archives share the directory, so files of archives
+   * that changed or were deleted are only ever removed here */
+  GArray* renditions = g_array_new(FALSE, FALSE, sizeof(rendition_t));
+  uint64_t usage = 0;
+  const char* name = NULL;
+  while ((name = g_dir_read_name(dir)) != NULL) {
+    char* path = g_build_filename(thumbnails->directory, name, NULL);
+    GStatBuf buf;
+    if (g_stat(path, &buf) == 0 && S_ISREG(buf.st_mode)) {
+      rendition_t rendition = { path, buf.st_mtime, buf.st_size };
+      g_array_append_val(renditions, rendition);
+      usage += buf.st_size;
+    } else {
+      g_free(path);
+    }
+  }
+  g_dir_close(dir);
+
+  /* delete the least recently used renditions down to three quarters of the
+   * budget, so that the directory is not scanned again on the next write */
+  if (thumbnails->max_size > 0 && usage > thumbnails->max_size) {
+    g_array_sort(renditions, compare_renditions);
+    for (guint i = 0; i < renditions->len && usage > thumbnails->max_size / 4 * 3; i++) {
+      const rendition_t* rendition = &g_array_index(renditions, rendition_t, i);
+      if (g_unlink(rendition->path) == 0) {
+        usage -= rendition->size;
+      }
+    }
+  }
+
+  for (guint i = 0; i < renditions->len; i++) {
+    g_free(g_array_index(renditions, rendition_t, i).path);
+  }
+  g_array_free(renditions, TRUE);
+
+  thumbnails->usage = usage;
+}
+
+void*
+cb_thumbnails_read(cb_thumbnails_t* thumbnails, const char* file, unsigned int entry,
+    unsigned int size, size_t* length)
+{
+  if (thumbnails == NULL || file == NULL || length == NULL) {
+    return NULL;
+  }
+
+  char* path = get_rendition_path(thumbnails, file, entry, size);
+  char* data = NULL;
+  gsize data_length = 0;
+  if (g_file_get_contents(path, &data, &data_length, NULL) == FALSE) {
+    data = NULL;
+  } else {
+    /* the modification time orders the renditions by their last use */
+    g_utime(path, NULL);
+  }
+  g_free(path);
+
+  *length = data_length;
+  return data;
+}
+
+static void
+write_rendition(cb_thumbnails_t* thumbnails, const char* path, const void* data, size_t length)
+{
+  g_mutex_lock(&thumbnails->lock);
+  if (thumbnails->created == false) {
+    if (g_mkdir_with_parents(thumbnails->directory, 0700) != 0) {
+      g_mutex_unlock(&thumbnails->lock);
+      return;
+    }
+    thumbnails->created = true;
+  }
+  if (thumbnails->scanned == false) {
+    prune(thumbnails);
+    thumbnails->scanned = true;
+  }
+  g_mutex_unlock(&thumbnails->lock);
+
+  /* written to a temporary file and renamed, so concurrent readers never see
+   * a partial rendition */
+  const bool written = g_file_set_contents(path, data, length, NULL) == TRUE;
+
+  /* other processes may write to the directory as well, so it is scanned
+   * again when the budget seems to be exceeded */
+  if (written == true) {
+    g_mutex_lock(&thumbnails->lock);
+    thumbnails->usage += length;
+    if (thumbnails->max_size > 0 && thumbnails->usage > thumbnails->max_size) {
+      prune(thumbnails);
+    }
+    g_mutex_unlock(&thumbnails->lock);
+  }
+}
+
+static bool
+encode_surface(cairo_surface_t* surface, gchar** buffer, gsize* length)
+{
+  GdkPixbuf* pixbuf = gdk_pixbuf_get_from_surface(surface, 0, 0,
+      cairo_image_surface_get_width(surface), cairo_image_surface_get_height(surface));
+  if (pixbuf == NULL) {
+    return false;
+  }
+
+  /* JPEG is far smaller and faster to decode; PNG keeps transparency */
+  gboolean saved = FALSE;
+  if (gdk_pixbuf_get_has_alpha(pixbuf) == TRUE) {
+    saved = gdk_pixbuf_save_to_buffer(pixbuf, buffer, length, "png", NULL, NULL);
+  } else {
+    saved = gdk_pixbuf_save_to_buffer(pixbuf, buffer, length, "jpeg", NULL,
+        "quality", "90", NULL);
+  }
+  g_object_unref(pixbuf);
+
+  return saved == TRUE;
+}
+
+static void
+store_rendition(gpointer data, gpointer user_data)
+{
+  rendition_job_t* job = data;
+  cb_thumbnails_t* thumbnails = user_data;
+
+  if (g_atomic_int_get(&thumbnails->closing) == 0) {
+    gchar* buffer = NULL;
+    gsize length = 0;
+    if (encode_surface(job->surface, &buffer, &length) == true) {
+      write_rendition(thumbnails, job->path, buffer, length);
+    }
+    g_free(buffer);
+  }
+
+  g_mutex_lock(&thumbnails->lock);
+  g_hash_table_remove(thumbnails->pending, job->path);
+  g_mutex_unlock(&thumbnails->lock);
+
+  cairo_surface_destroy(job->surface);
+  g_free(job->path);
+  g_free(job);
+}
+
+void
+cb_thumbnails_store(cb_thumbnails_t* thumbnails, const char* file, unsigned int entry,
+    unsigned int size, cairo_surface_t* surface)
+{
+  if (thumbnails == NULL || file == NULL || surface == NULL) {
+    return;
+  }
+
+  char* path = get_rendition_path(thumbnails, file, entry, size);
+
+  /* the displayed page and the read-ahead may both miss the same rendition */
+  g_mutex_lock(&thumbnails->lock);
+  const bool queue = g_hash_table_contains(thumbnails->pending, path) == FALSE
+    && g_hash_table_size(thumbnails->pending) < MAX_PENDING_RENDITIONS;
+  if (queue == true) {
+    g_hash_table_add(thumbnails->pending, g_strdup(path));
+  }
+  g_mutex_unlock(&thumbnails->lock);
+
+  if (queue == false) {
+    g_free(path);
+    return;
+  }
+
+  rendition_job_t* job = g_malloc(sizeof(rendition_job_t));
+  job->path = path;
+  job->surface = cairo_surface_reference(surface);
+  g_thread_pool_push(thumbnails->pool, job, NULL);
+}
@@ -0,0 +1,62 @@
+/* See LICENSE file for license and copyright information */
+
+#ifndef THUMBNAILS_H
+#define THUMBNAILS_H
+
+#include <stddef.h>
+#include <cairo.h>
+
+#include <girara/macros.h>
+
+typedef struct cb_thumbnails_s cb_thumbnails_t;
+
+/**
+ * Opens the on-disk store of reduced renditions of the pages of an archive.
+ * Renditions live in $XDG_CACHE_HOME/zathura-cb/thumbnails/, one file per
+ * page and size, and are keyed by the fingerprint of the archive, the
+ * position and path of the entry and the size of the rendition; paths alone
+ * are not unique in zip archives. The directory is shared by all
+ * archives; when it grows beyond its budget, the least recently used
+ * renditions are deleted.
+ *
+ * @param fingerprint Fingerprint of the archive, see cb_metadata_get_fingerprint
+ * @param max_size Budget of the directory in bytes, 0 for no limit
+ * @return The store
+ */
+GIRARA_HIDDEN cb_thumbnails_t* cb_thumbnails_new(const char* fingerprint, size_t max_size);
+
+/**
+ * Frees the store
+ *
+ * @param thumbnails The store
+ */
+GIRARA_HIDDEN void cb_thumbnails_free(cb_thumbnails_t* thumbnails);
+
+/**
+ * Reads an encoded rendition of a page. May be called from any thread.
+ *
+ * @param thumbnails The store
+ * @param file Path of the page in the archive
+ * @param entry Position of the entry of the page in the archive
+ * @param size Size of the rendition
+ * @param length Set to the length of the data
+ * @return The data, to be freed with g_free, or NULL if there is no rendition
+ */
+GIRARA_HIDDEN void* cb_thumbnails_read(cb_thumbnails_t* thumbnails, const char* file,
+    unsigned int entry, unsigned int size, size_t* length);
+
+/**
+ * Stores a rendition of a page. The image is encoded and written by a worker
+ * thread of the store, so this returns right away; the surface must not be
+ * modified afterwards. May be called from any thread.
+ *
+ * @param thumbnails The store
+ * @param file Path of the page in the archive
+ * @param entry Position of the entry of the page in the archive
+ * @param size Size of the rendition
+ * @param surface Image of the rendition
+ */
+GIRARA_HIDDEN void cb_thumbnails_store(cb_thumbnails_t* thumbnails, const char* file,
+    unsigned int entry, unsigned int size, cairo_surface_t* surface);
+
+#endif // THUMBNAILS_H
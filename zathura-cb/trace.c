@@ -0,0 +1,153 @@
+/* See LICENSE file for license and copyright information */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <glib.h>
+
+#include "trace.h"
+#include "utils.h"
+
+#ifdef CB_TRACE_SDT
+#include <sys/sdt.h>
+#endif
+#ifdef CB_TRACE_SYSPROF
+#include <sysprof-capture.h>
+#endif
+
+/** Runtime configuration and state of the trace outputs
+ */
+typedef struct cb_trace_s {
+  bool log; /**< Log spans to stderr */
+  bool enabled; /**< Spans are recorded at all */
+  GMutex lock; /**< Protects file */
+  FILE* file; /**< Chrome trace event file, NULL if disabled */
+} cb_trace_t;
+
+static _Thread_local unsigned int thread_id = 0;
+static gint next_thread_id = 0;
+
+static cb_trace_t*
+get_trace(void)
+{
+  static cb_trace_t trace;
+  static gsize initialized = 0;
+
+  if (g_once_init_enter(&initialized)) {
+    g_mutex_init(&trace.lock);
+    trace.log = get_env_uint("ZATHURA_CB_TRACE", 0) != 0;
+
+    /* the JSON array is never closed, which the format allows for traces
+     * that end abruptly */
+    const char* path = g_getenv("ZATHURA_CB_TRACE_FILE");
+    if (path != NULL && path[0] != '\0') {
+      trace.file = fopen(path, "w");
+      if (trace.file != NULL) {
+        fputs("[\n", trace.file);
+      }
+    }
+
+    trace.enabled = trace.log == true || trace.file != NULL;
+#if defined(CB_TRACE_SDT) || defined(CB_TRACE_SYSPROF)
+    trace.enabled = true;
+#endif
+
+    g_once_init_leave(&initialized, 1);
+  }
+
+  return &trace;
+}
+
+static unsigned int
+get_thread_id(void)
+{
+  if (thread_id == 0) {
+    thread_id = g_atomic_int_add(&next_thread_id, 1) + 1;
+  }
+
+  return thread_id;
+}
+
+static void
+record(const char* name, int64_t start, int64_t duration, const char* arg, int64_t value)
+{
+  cb_trace_t* trace = get_trace();
+
+  if (trace->log == true) {
+    if (duration < 0) {
+      fprintf(stderr, "cb-trace: [%u] %s %s=%" G_GINT64_FORMAT "\n", get_thread_id(), name,
+          arg != NULL ? arg : "", value);
+    } else {
+      fprintf(stderr, "cb-trace: [%u] %s %.3f ms %s=%" G_GINT64_FORMAT "\n", get_thread_id(),
+          name, duration / 1000.0, arg != NULL ? arg : "", value);
+    }
+  }
+
+  if (trace->file != NULL) {
+    g_mutex_lock(&trace->lock);
+    if (duration < 0) {
+      fprintf(trace->file, "{\"name\": \"%s\", \"ph\": \"i\", \"s\": \"t\", \"ts\": %" G_GINT64_FORMAT
+          ", \"pid\": %d, \"tid\": %u", name, start, (int) getpid(), get_thread_id());
+    } else {
+      fprintf(trace->file, "{\"name\": \"%s\", \"ph\": \"X\", \"ts\": %" G_GINT64_FORMAT
+          ", \"dur\": %" G_GINT64_FORMAT ", \"pid\": %d, \"tid\": %u", name, start, duration,
+          (int) getpid(), get_thread_id());
+    }
+    if (arg != NULL) {
+      fprintf(trace->file, ", \"args\": {\"%s\": %" G_GINT64_FORMAT "}", arg, value);
+    }
+    fputs("},\n", trace->file);
+    g_mutex_unlock(&trace->lock);
+  }
+
+#ifdef CB_TRACE_SDT
+  DTRACE_PROBE4(zathura_cb, span, name, duration, arg, value);
+#endif
+#ifdef CB_TRACE_SYSPROF
+  char* message = arg != NULL ? g_strdup_printf("%s=%" G_GINT64_FORMAT, arg, value) : NULL;
+  sysprof_collector_mark(start * 1000, MAX(duration, 0) * 1000, "zathura-cb", name, message);
+  g_free(message);
+#endif
+}
+
+cb_trace_span_t
+cb_trace_begin(const char* name)
+{
+  cb_trace_span_t span = { name, 0 };
+  if (get_trace()->enabled == true) {
+    span.start = g_get_monotonic_time();
+  }
+
+  return span;
+}
+
+void
+cb_trace_end(const cb_trace_span_t* span, const char* arg, int64_t value)
+{
+  if (span->start == 0) {
+    return;
+  }
+
+  record(span->name, span->start, g_get_monotonic_time() - span->start, arg, value);
+}
+
+void
+cb_trace_instant(const char* name, const char* arg, int64_t value)
+{
+  if (get_trace()->enabled == false) {
+    return;
+  }
+
+  record(name, g_get_monotonic_time(), -1, arg, value);
+}
+
+void
+cb_trace_flush(void)
+{
+  cb_trace_t* trace = get_trace();
+  if (trace->file != NULL) {
+    g_mutex_lock(&trace->lock);
+    fflush(trace->file);
+    g_mutex_unlock(&trace->lock);
+  }
+}
@@ -0,0 +1,75 @@
+/* See LICENSE file for license and copyright information */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+#include <girara/macros.h>
+
+/* Timing of the stages of opening archives and rendering pages. Tracing is
+ * only compiled in when building with -Dtrace=true; otherwise the macros
+ * below expand to nothing and their arguments are not evaluated.
+ *
+ * At runtime, ZATHURA_CB_TRACE=1 logs every span to stderr and
+ * ZATHURA_CB_TRACE_FILE=path writes them in the Chrome trace event format,
+ * which can be loaded into chrome://tracing or Perfetto. If available at
+ * build time, every span is also reported as a USDT probe
+ * (zathura_cb:span) and as a sysprof mark regardless of these variables. */
+
+#ifdef CB_TRACE
+
+/** A running span
+ */
+typedef struct cb_trace_span_s {
+  const char* name; /**< Name of the stage */
+  int64_t start; /**< Monotonic start time in microseconds, 0 if not traced */
+} cb_trace_span_t;
+
+/**
+ * Starts a span
+ *
+ * @param name Name of the stage; must be a string literal
+ * @return The span
+ */
+GIRARA_HIDDEN cb_trace_span_t cb_trace_begin(const char* name);
+
+/**
+ * Ends a span and records it. Spans of stages that failed are ended with
+ * the value "error" set to 1, so that every span is recorded.
+ *
+ * @param span The span
+ * @param arg Name of a value describing the span, e.g. "bytes", or NULL
+ * @param value The value
+ */
+GIRARA_HIDDEN void cb_trace_end(const cb_trace_span_t* span, const char* arg, int64_t value);
+
+/**
+ * Records an event without a duration, e.g. a cache hit
+ *
+ * @param name Name of the event; must be a string literal
+ * @param arg Name of a value describing the event or NULL
+ * @param value The value
+ */
+GIRARA_HIDDEN void cb_trace_instant(const char* name, const char* arg, int64_t value);
+
+/**
+ * Writes buffered events to the trace file
+ */
+GIRARA_HIDDEN void cb_trace_flush(void);
+
+#define CB_TRACE_BEGIN(span, name) cb_trace_span_t span = cb_trace_begin(name)
+#define CB_TRACE_END(span, arg, value) cb_trace_end(&(span), (arg), (value))
+#define CB_TRACE_INSTANT(name, arg, value) cb_trace_instant((name), (arg), (value))
+#define CB_TRACE_FLUSH() cb_trace_flush()
+
+#else
+
+#define CB_TRACE_BEGIN(span, name)
+#define CB_TRACE_END(span, arg, value)
+#define CB_TRACE_INSTANT(name, arg, value)
+#define CB_TRACE_FLUSH()
+
+#endif
+
+#endif // TRACE_H
@@ -4,14 +4,28 @@
 
 #include "utils.h"
 
-int
-compare_path(const char* str1, const char* str2)
+char*
+get_path_sort_key(const char* path)
 {
-  char* ustr1 = g_utf8_casefold(str1, -1);
-  char* ustr2 = g_utf8_casefold(str2, -1);
-  int result  = g_utf8_collate(ustr1, ustr2);
-  g_free(ustr1);
-  g_free(ustr2);
+  char* upath = g_utf8_casefold(path, -1);
+  char* key   = g_utf8_collate_key_for_filename(upath, -1);
+  g_free(upath);
+
+  return key;
+}
+
+unsigned int
+get_env_uint(const char* name, unsigned int default_value)
+{
+  const char* value = g_getenv(name);
+  if (value == NULL || *value == '\0') {
+    return default_value;
+  }
+
+  guint64 result = 0;
+  if (g_ascii_string_to_unsigned(value, 10, 0, G_MAXUINT, &result, NULL) == FALSE) {
+    return default_value;
+  }
 
   return result;
 }
@@ -6,13 +6,24 @@
 #include <girara/macros.h>
 
 /**
- * Compares two paths with each other
+ * Creates a key to sort paths by. Keys compare case-insensitively and order
+ * numbers by their value, e.g. page9 before page10, and can be compared with
+ * strcmp.
  *
- * @param str1 First path
- * @param str2 Second path
+ * @param path The path
  *
- * @return   
+ * @return The sort key, to be freed with g_free
  */
-GIRARA_HIDDEN int compare_path(const char* str1, const char* str2);
+GIRARA_HIDDEN char* get_path_sort_key(const char* path);
+
+/**
+ * Reads an unsigned integer setting from the environment
+ *
+ * @param name Name of the environment variable
+ * @param default_value Value to use if the variable is unset or invalid
+ *
+ * @return The value of the variable or default_value
+ */
+GIRARA_HIDDEN unsigned int get_env_uint(const char* name, unsigned int default_value);
 
 #endif // UTILS_H
@@ -0,0 +1,466 @@
+/* See LICENSE file for license and copyright information */
+
+#include <glib.h>
+#include <string.h>
+
+#include "inflate.h"
+#include "zip.h"
+
+#define ZIP_LOCAL_HEADER_SIGNATURE 0x04034b50
+#define ZIP_CENTRAL_HEADER_SIGNATURE 0x02014b50
+#define ZIP_END_SIGNATURE 0x06054b50
+#define ZIP64_END_SIGNATURE 0x06064b50
+#define ZIP64_LOCATOR_SIGNATURE 0x07064b50
+
+#define ZIP_LOCAL_HEADER_SIZE 30
+/* local extra fields are often a bit longer than their central counterparts,
+ * e.g. extended timestamps also carry the access time there */
+#define ZIP_LOCAL_EXTRA_SLACK 64
+#define ZIP_CENTRAL_HEADER_SIZE 46
+#define ZIP_END_SIZE 22
+#define ZIP64_END_SIZE 56
+#define ZIP64_LOCATOR_SIZE 20
+#define ZIP_MAX_COMMENT_SIZE 65535
+
+#define ZIP64_EXTRA_ID 0x0001
+
+#define ZIP_FLAG_ENCRYPTED 0x0001
+#define ZIP_FLAG_UTF8 0x0800
+
+#define ZIP_METHOD_STORED 0
+#define ZIP_METHOD_DEFLATED 8
+
+struct cb_zip_s {
+  cb_source_t* source; /**< The archive file */
+  GArray* entries; /**< Array of cb_zip_entry_t in central directory order */
+  GPtrArray* by_position; /**< Entries in the order of their data */
+};
+
+static inline uint16_t
+read_u16(const unsigned char* p)
+{
+  return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t
+read_u32(const unsigned char* p)
+{
+  return (uint32_t) read_u16(p) | ((uint32_t) read_u16(p + 2) << 16);
+}
+
+static inline uint64_t
+read_u64(const unsigned char* p)
+{
+  return (uint64_t) read_u32(p) | ((uint64_t) read_u32(p + 4) << 32);
+}
+
+/** Location of the central directory
+ */
+typedef struct zip_directory_s {
+  uint64_t entries; /**< Number of entries */
+  uint64_t size; /**< Size in bytes */
+  uint64_t offset; /**< Offset in the file as recorded in the archive */
+  int64_t end; /**< Offset of the record following the directory in the file */
+} zip_directory_t;
+
+static bool
+read_zip64_end(cb_source_t* source, int64_t end_offset, zip_directory_t* directory)
+{
+  unsigned char locator[ZIP64_LOCATOR_SIZE];
+  if (end_offset < ZIP64_LOCATOR_SIZE
+      || cb_source_read(source, locator, sizeof(locator), end_offset - ZIP64_LOCATOR_SIZE) == false
+      || read_u32(locator) != ZIP64_LOCATOR_SIGNATURE || read_u32(locator + 16) > 1) {
+    return false;
+  }
+
+  /* the record offset is subject to the same shift as the directory offset;
+   * the record normally sits right before the locator */
+  int64_t offset = end_offset - ZIP64_LOCATOR_SIZE - ZIP64_END_SIZE;
+  unsigned char record[ZIP64_END_SIZE];
+  if (offset < 0 || cb_source_read(source, record, sizeof(record), offset) == false
+      || read_u32(record) != ZIP64_END_SIGNATURE) {
+    const uint64_t recorded = read_u64(locator + 8);
+    if (recorded > INT64_MAX) {
+      return false;
+    }
+    offset = recorded;
+    if (cb_source_read(source, record, sizeof(record), offset) == false
+        || read_u32(record) != ZIP64_END_SIGNATURE) {
+      return false;
+    }
+  }
+
+  /* multi-disk archives are not supported */
+  if (read_u32(record + 16) != 0 || read_u32(record + 20) != 0) {
+    return false;
+  }
+
+  directory->entries = read_u64(record + 32);
+  directory->size = read_u64(record + 40);
+  directory->offset = read_u64(record + 48);
+  directory->end = offset;
+  return true;
+}
+
+static bool
+find_directory(cb_source_t* source, zip_directory_t* directory)
+{
+  /* the end of central directory record is followed by a comment of up to
+   * 64 KiB, so look for its signature from the end */
+  const int64_t file_size = cb_source_get_size(source);
+  if (file_size < ZIP_END_SIZE) {
+    return false;
+  }
+
+  const size_t tail_size = MIN(file_size, ZIP_END_SIZE + ZIP_MAX_COMMENT_SIZE);
+  unsigned char* tail = g_malloc(tail_size);
+  if (cb_source_read(source, tail, tail_size, file_size - tail_size) == false) {
+    g_free(tail);
+    return false;
+  }
+
+  const unsigned char* end = NULL;
+  for (size_t i = tail_size - ZIP_END_SIZE + 1; i > 0; i--) {
+    const unsigned char* p = tail + i - 1;
+    if (read_u32(p) == ZIP_END_SIGNATURE && read_u16(p + 20) <= tail_size - (i - 1) - ZIP_END_SIZE) {
+      end = p;
+      break;
+    }
+  }
+
+  if (end == NULL || read_u16(end + 4) != 0 || read_u16(end + 6) != 0) {
+    g_free(tail);
+    return false;
+  }
+
+  const int64_t end_offset = file_size - tail_size + (end - tail);
+  directory->entries = read_u16(end + 10);
+  directory->size = read_u32(end + 12);
+  directory->offset = read_u32(end + 16);
+  directory->end = end_offset;
+  g_free(tail);
+
+  if (directory->entries == 0xffff || directory->size == 0xffffffff
+      || directory->offset == 0xffffffff) {
+    return read_zip64_end(source, end_offset, directory);
+  }
+
+  /* ZIP64 archives may also record the real values in the ZIP64 record only
+   * when they fit; use it if present */
+  zip_directory_t zip64;
+  if (read_zip64_end(source, end_offset, &zip64) == true) {
+    *directory = zip64;
+  }
+
+  return true;
+}
+
+static bool
+parse_zip64_extra(const unsigned char* extra, size_t length, cb_zip_entry_t* entry,
+    bool uncompressed, bool compressed, bool offset)
+{
+  while (length >= 4) {
+    const uint16_t id = read_u16(extra);
+    const uint16_t size = read_u16(extra + 2);
+    if (size > length - 4) {
+      return false;
+    }
+
+    if (id == ZIP64_EXTRA_ID) {
+      /* only the fields that overflowed are present, in this order */
+      const unsigned char* p = extra + 4;
+      const unsigned char* p_end = p + size;
+      if (uncompressed == true) {
+        if (p + 8 > p_end) {
+          return false;
+        }
+        entry->uncompressed_size = read_u64(p);
+        p += 8;
+      }
+      if (compressed == true) {
+        if (p + 8 > p_end) {
+          return false;
+        }
+        entry->compressed_size = read_u64(p);
+        p += 8;
+      }
+      if (offset == true) {
+        if (p + 8 > p_end) {
+          return false;
+        }
+        entry->local_header_offset = read_u64(p);
+      }
+      return true;
+    }
+
+    extra += 4 + size;
+    length -= 4 + size;
+  }
+
+  /* overflowed fields without ZIP64 extra field */
+  return uncompressed == false && compressed == false && offset == false;
+}
+
+static char*
+convert_name(const unsigned char* name, size_t length, uint16_t flags)
+{
+  if ((flags & ZIP_FLAG_UTF8) != 0 || g_utf8_validate((const char*) name, length, NULL) == TRUE) {
+    return g_strndup((const char*) name, length);
+  }
+
+  /* the legacy encoding of zip file names */
+  char* converted = g_convert((const char*) name, length, "UTF-8", "CP437", NULL, NULL, NULL);
+  return converted != NULL ? converted : g_strndup((const char*) name, length);
+}
+
+static bool
+parse_directory(cb_zip_t* zip, const unsigned char* data, size_t size, uint64_t entries,
+    int64_t shift)
+{
+  const unsigned char* p = data;
+  const unsigned char* end = data + size;
+  for (uint64_t i = 0; i < entries; i++) {
+    if (end - p < ZIP_CENTRAL_HEADER_SIZE || read_u32(p) != ZIP_CENTRAL_HEADER_SIGNATURE) {
+      return false;
+    }
+
+    const uint16_t name_length = read_u16(p + 28);
+    const uint16_t extra_length = read_u16(p + 30);
+    const uint16_t comment_length = read_u16(p + 32);
+    const size_t record_size = (size_t) ZIP_CENTRAL_HEADER_SIZE + name_length + extra_length + comment_length;
+    if ((size_t) (end - p) < record_size || read_u16(p + 34) != 0) {
+      return false;
+    }
+
+    cb_zip_entry_t entry = {
+      .flags = read_u16(p + 8),
+      .method = read_u16(p + 10),
+      .crc32 = read_u32(p + 16),
+      .compressed_size = read_u32(p + 20),
+      .uncompressed_size = read_u32(p + 24),
+      .local_header_offset = read_u32(p + 42),
+      .name_length = name_length,
+      .extra_length = extra_length
+    };
+
+    if (parse_zip64_extra(p + ZIP_CENTRAL_HEADER_SIZE + name_length, extra_length, &entry,
+          entry.uncompressed_size == 0xffffffff, entry.compressed_size == 0xffffffff,
+          entry.local_header_offset == 0xffffffff) == false) {
+      return false;
+    }
+    entry.local_header_offset += shift;
+
+    /* the upper half of the external attributes holds the unix mode if the
+     * archive was created on unix; some tools leave out the file type */
+    const uint8_t host = p[5];
+    const uint32_t mode = read_u32(p + 38) >> 16;
+    entry.name = convert_name(p + ZIP_CENTRAL_HEADER_SIZE, name_length, entry.flags);
+    entry.is_file = name_length > 0 && p[ZIP_CENTRAL_HEADER_SIZE + name_length - 1] != '/'
+      && (host != 3 || (mode & 0170000) == 0 || (mode & 0170000) == 0100000);
+
+    g_array_append_val(zip->entries, entry);
+    p += record_size;
+  }
+
+  return true;
+}
+
+static int
+compare_offsets(const void* data1, const void* data2)
+{
+  const cb_zip_entry_t* entry1 = *(const cb_zip_entry_t**) data1;
+  const cb_zip_entry_t* entry2 = *(const cb_zip_entry_t**) data2;
+
+  return (entry1->local_header_offset > entry2->local_header_offset)
+    - (entry1->local_header_offset < entry2->local_header_offset);
+}
+
+static void
+zip_entry_clear(cb_zip_entry_t* entry)
+{
+  g_free(entry->name);
+  entry->name = NULL;
+}
+
+cb_zip_t*
+cb_zip_open(cb_source_t* source)
+{
+  zip_directory_t directory;
+  if (source == NULL || find_directory(source, &directory) == false
+      || directory.size > (uint64_t) directory.end
+      || directory.entries > directory.size / ZIP_CENTRAL_HEADER_SIZE) {
+    return NULL;
+  }
+
+  /* Self-extracting archives have data in front of the archive that the
+   * recorded offsets do not include. The directory ends where the end record
+   * begins, which gives the shift. */
+  const int64_t directory_offset = directory.end - directory.size;
+  if ((uint64_t) directory_offset < directory.offset) {
+    return NULL;
+  }
+  const int64_t shift = directory_offset - directory.offset;
+
+  unsigned char* data = g_try_malloc(MAX(directory.size, 1));
+  if (data == NULL || cb_source_read(source, data, directory.size, directory_offset) == false) {
+    g_free(data);
+    return NULL;
+  }
+
+  cb_zip_t* zip = g_malloc0(sizeof(cb_zip_t));
+  zip->source = source;
+  zip->entries = g_array_sized_new(FALSE, TRUE, sizeof(cb_zip_entry_t), directory.entries);
+  g_array_set_clear_func(zip->entries, (GDestroyNotify) zip_entry_clear);
+
+  const bool ok = parse_directory(zip, data, directory.size, directory.entries, shift);
+  g_free(data);
+  if (ok == false) {
+    cb_zip_free(zip);
+    return NULL;
+  }
+
+  /* number the entries in the order of their data, which is the order in
+   * which libarchive returns them */
+  zip->by_position = g_ptr_array_sized_new(zip->entries->len);
+  for (guint i = 0; i < zip->entries->len; i++) {
+    g_ptr_array_add(zip->by_position, &g_array_index(zip->entries, cb_zip_entry_t, i));
+  }
+  g_ptr_array_sort(zip->by_position, compare_offsets);
+  for (guint i = 0; i < zip->by_position->len; i++) {
+    ((cb_zip_entry_t*) g_ptr_array_index(zip->by_position, i))->position = i;
+  }
+
+  return zip;
+}
+
+void
+cb_zip_free(cb_zip_t* zip)
+{
+  if (zip == NULL) {
+    return;
+  }
+
+  if (zip->by_position != NULL) {
+    g_ptr_array_free(zip->by_position, TRUE);
+  }
+  if (zip->entries != NULL) {
+    g_array_free(zip->entries, TRUE);
+  }
+  g_free(zip);
+}
+
+unsigned int
+cb_zip_get_number_of_entries(cb_zip_t* zip)
+{
+  return zip != NULL ? zip->entries->len : 0;
+}
+
+const cb_zip_entry_t*
+cb_zip_get_entry(cb_zip_t* zip, unsigned int index)
+{
+  if (zip == NULL || index >= zip->entries->len) {
+    return NULL;
+  }
+
+  return &g_array_index(zip->entries, cb_zip_entry_t, index);
+}
+
+const cb_zip_entry_t*
+cb_zip_get_entry_by_position(cb_zip_t* zip, unsigned int position)
+{
+  if (zip == NULL || position >= zip->by_position->len) {
+    return NULL;
+  }
+
+  return g_ptr_array_index(zip->by_position, position);
+}
+
+bool
+cb_zip_can_read_entry(const cb_zip_entry_t* entry)
+{
+  return entry != NULL && (entry->flags & ZIP_FLAG_ENCRYPTED) == 0
+    && (entry->method == ZIP_METHOD_STORED || entry->method == ZIP_METHOD_DEFLATED)
+    && entry->uncompressed_size <= G_MAXSIZE - 1 && entry->compressed_size <= G_MAXSIZE / 2;
+}
+
+void*
+cb_zip_read_entry(cb_zip_t* zip, const cb_zip_entry_t* entry, size_t limit, size_t* size)
+{
+  if (zip == NULL || size == NULL || cb_zip_can_read_entry(entry) == false) {
+    return NULL;
+  }
+
+  const int64_t file_size = cb_source_get_size(zip->source);
+  if (entry->local_header_offset > (uint64_t) file_size) {
+    return NULL;
+  }
+
+  /* A prefix of a deflated entry needs at most slightly more compressed
+   * bytes than it has (stored blocks), so the whole entry is only read if
+   * needed. */
+  const bool partial = limit > 0 && limit < entry->uncompressed_size;
+  const size_t out_size = partial == true ? limit : entry->uncompressed_size;
+  size_t in_size = entry->compressed_size;
+  if (partial == true) {
+    in_size = MIN(in_size, entry->method == ZIP_METHOD_STORED ? limit : limit + limit / 8 + 1024);
+  }
+
+  /* Read the local header together with the data, assuming its name and
+   * extra field are about as long as in the central directory. If the local
+   * header turns out to be longer, only the missing end of the data is read
+   * in a second step. */
+  const uint64_t available = (uint64_t) file_size - entry->local_header_offset;
+  size_t header_size = ZIP_LOCAL_HEADER_SIZE + entry->name_length + entry->extra_length
+    + ZIP_LOCAL_EXTRA_SLACK;
+  size_t read_size = MIN(header_size + in_size, available);
+  unsigned char* buffer = g_try_malloc(MAX(read_size, 1));
+  if (buffer == NULL || read_size < ZIP_LOCAL_HEADER_SIZE
+      || cb_source_read(zip->source, buffer, read_size, entry->local_header_offset) == false
+      || read_u32(buffer) != ZIP_LOCAL_HEADER_SIGNATURE) {
+    g_free(buffer);
+    return NULL;
+  }
+
+  header_size = ZIP_LOCAL_HEADER_SIZE + read_u16(buffer + 26) + read_u16(buffer + 28);
+  if (header_size > available) {
+    g_free(buffer);
+    return NULL;
+  }
+  in_size = MIN(in_size, available - header_size);
+  if (header_size + in_size > read_size) {
+    unsigned char* grown = g_try_realloc(buffer, header_size + in_size);
+    if (grown == NULL || cb_source_read(zip->source, grown + read_size,
+          header_size + in_size - read_size, entry->local_header_offset + read_size) == false) {
+      g_free(grown != NULL ? grown : buffer);
+      return NULL;
+    }
+    buffer = grown;
+    read_size = header_size + in_size;
+  }
+  const unsigned char* data = buffer + header_size;
+
+  unsigned char* result = g_try_malloc(MAX(out_size, 1));
+  bool ok = result != NULL;
+  if (ok == true && entry->method == ZIP_METHOD_STORED) {
+    ok = in_size >= out_size;
+    if (ok == true) {
+      memcpy(result, data, out_size);
+      *size = out_size;
+    }
+  } else if (ok == true) {
+    ok = cb_inflate(data, in_size, result, out_size, partial, size);
+  }
+
+  /* a whole entry can be verified */
+  if (ok == true && partial == false) {
+    ok = cb_crc32(0, result, *size) == entry->crc32;
+  }
+
+  g_free(buffer);
+  if (ok == false) {
+    g_free(result);
+    return NULL;
+  }
+
+  return result;
+}
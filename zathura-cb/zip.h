@@ -0,0 +1,100 @@
+/* See LICENSE file for license and copyright information */
+
+#ifndef ZIP_H
+#define ZIP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <girara/macros.h>
+
+#include "source.h"
+
+typedef struct cb_zip_s cb_zip_t;
+
+/** An entry of the central directory of a zip archive
+ */
+typedef struct cb_zip_entry_s {
+  char* name; /**< Path of the entry, converted to UTF-8 */
+  unsigned int position; /**< Position of the entry in the archive by local header offset */
+  bool is_file; /**< Whether the entry is a regular file */
+  uint16_t flags; /**< General purpose flags */
+  uint16_t method; /**< Compression method */
+  uint32_t crc32; /**< CRC-32 of the uncompressed data */
+  uint64_t compressed_size; /**< Size of the stored data */
+  uint64_t uncompressed_size; /**< Size of the uncompressed data */
+  uint64_t local_header_offset; /**< Offset of the local header in the file */
+  uint16_t name_length; /**< Length of the path as stored, before conversion */
+  uint16_t extra_length; /**< Length of the extra field in the central directory */
+} cb_zip_entry_t;
+
+/**
+ * Reads the central directory of a zip archive, including ZIP64 archives,
+ * without touching the data of the entries. Only single-disk archives are
+ * supported.
+ *
+ * @param source The archive file; it must outlive the zip archive
+ * @return The zip archive or NULL if the file is not a supported zip archive
+ */
+GIRARA_HIDDEN cb_zip_t* cb_zip_open(cb_source_t* source);
+
+/**
+ * Frees the central directory
+ *
+ * @param zip The zip archive
+ */
+GIRARA_HIDDEN void cb_zip_free(cb_zip_t* zip);
+
+/**
+ * Returns the number of entries of the central directory
+ *
+ * @param zip The zip archive
+ * @return The number of entries
+ */
+GIRARA_HIDDEN unsigned int cb_zip_get_number_of_entries(cb_zip_t* zip);
+
+/**
+ * Returns an entry in central directory order
+ *
+ * @param zip The zip archive
+ * @param index Index of the entry
+ * @return The entry or NULL if the index is out of range
+ */
+GIRARA_HIDDEN const cb_zip_entry_t* cb_zip_get_entry(cb_zip_t* zip, unsigned int index);
+
+/**
+ * Returns an entry by its position in the archive. Unlike paths, positions
+ * identify entries even if several of them have the same path.
+ *
+ * @param zip The zip archive
+ * @param position Position of the entry, see cb_zip_entry_t
+ * @return The entry or NULL if the position is out of range
+ */
+GIRARA_HIDDEN const cb_zip_entry_t* cb_zip_get_entry_by_position(cb_zip_t* zip,
+    unsigned int position);
+
+/**
+ * Checks whether an entry can be read by cb_zip_read_entry
+ *
+ * @param entry The entry
+ * @return true if the entry is stored or deflated and not encrypted
+ */
+GIRARA_HIDDEN bool cb_zip_can_read_entry(const cb_zip_entry_t* entry);
+
+/**
+ * Reads and decompresses an entry. The local header and the compressed data
+ * are read at once. Only stored and deflated entries without encryption are
+ * supported. Whole entries are checked against their CRC-32.
+ *
+ * @param zip The zip archive
+ * @param entry The entry
+ * @param limit Maximum number of bytes to decompress, 0 to read the whole entry
+ * @param size Set to the number of bytes returned
+ * @return The data, to be freed with g_free, or NULL if the entry is not
+ *   supported or an error occurred
+ */
+GIRARA_HIDDEN void* cb_zip_read_entry(cb_zip_t* zip, const cb_zip_entry_t* entry, size_t limit,
+    size_t* size);
+
+#endif // ZIP_H